@@ -19,6 +19,7 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
@@ -93,11 +94,14 @@ struct buf*
 bread(uint dev, uint blockno)
 {
   struct buf *b;
+  struct proc *p;
 
   b = bget(dev, blockno);
   if(!b->valid) {
     virtio_disk_rw(b, 0);
     b->valid = 1;
+    if((p = myproc()) != 0)
+      p->rblocks++;
   }
   return b;
 }
@@ -106,9 +110,13 @@ bread(uint dev, uint blockno)
 void
 bwrite(struct buf *b)
 {
+  struct proc *p;
+
   if(!holdingsleep(&b->lock))
     panic("bwrite");
   virtio_disk_rw(b, 1);
+  if((p = myproc()) != 0)
+    p->wblocks++;
 }
 
 // Release a locked buffer.
@@ -114,7 +114,16 @@ exec(char *path, char **argv)
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  p->trapframe->tp = 0;  // clone() passes a thread index here
+  // threads running in the old memory must not outlive it.
+  killclones(p);
+  if(p->isthread){
+    // the old memory belongs to the process that cloned us.
+    uvmunmap(oldpagetable, 0, PGROUNDUP(oldsz)/PGSIZE, 0);
+    proc_freepagetable(oldpagetable, 0);
+    p->isthread = 0;
+  } else
+    proc_freepagetable(oldpagetable, oldsz);
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
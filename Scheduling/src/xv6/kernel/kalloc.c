@@ -1,12 +1,15 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or, with kalloc_order(), physically contiguous
+// blocks of 2^order pages from a buddy allocator.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
@@ -16,37 +19,222 @@ extern char end[]; // first address after kernel.
 
 struct run {
   struct run *next;
+  struct run *prev;   // in the buddy free lists only
 };
 
-struct {
+// Free pages are cached per cpu, so that kalloc() and kfree()
+// normally take only their own cpu's lock, which others take
+// only to steal. Pages move between the caches and the global
+// pool, the buddy allocator, in batches of KBATCH: a cache that
+// runs dry refills from the pool, a block of order KBATCHORDER
+// if there is one, or else steals half of another cache; one
+// that grows past KHIGH gives a batch back, where the pages can
+// merge with their buddies again.
+#define KBATCHORDER 5
+#define KBATCH (1 << KBATCHORDER)
+#define KHIGH (2*KBATCH)
+
+struct kcache {
   struct spinlock lock;
   struct run *freelist;
+  int n;
+} kcache[NCPU];
+
+// The buddy allocator: a free block of order k is 2^k pages,
+// aligned to its size, and its buddy is the other half of the
+// block of order k+1 it was split from. Blocks are aligned in
+// physical memory, since KERNBASE is aligned to more than the
+// largest one, so a block of order 9 can back a 2 MB megapage.
+// order[] records, for the first page of each free block, its
+// order plus one; 0 for every other page.
+#define NPAGE ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PA2PG(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
+struct {
+  struct spinlock lock;
+  struct run *free[MAXORDER+1];   // doubly linked, any order
+  uchar order[NPAGE];
+  // per-order stats, for kallocdump().
+  int nfree[MAXORDER+1];          // free blocks
+  uint64 nalloc[MAXORDER+1];      // blocks handed out
+  uint64 nsplit[MAXORDER+1];      // blocks split in two
+  uint64 nmerge[MAXORDER+1];      // buddies merged into one
 } kmem;
 
+static void
+buddypush(struct run *r, int k)
+{
+  r->prev = 0;
+  r->next = kmem.free[k];
+  if(r->next)
+    r->next->prev = r;
+  kmem.free[k] = r;
+  kmem.order[PA2PG(r)] = k + 1;
+  kmem.nfree[k]++;
+}
+
+static void
+buddydel(struct run *r, int k)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.free[k] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.order[PA2PG(r)] = 0;
+  kmem.nfree[k]--;
+}
+
+// Take a free block of order k, splitting a larger one if
+// need be, or return 0. Caller must hold kmem.lock.
+static struct run*
+buddyalloc(int k)
+{
+  struct run *r;
+  int i;
+
+  for(i = k; i <= MAXORDER && kmem.free[i] == 0; i++)
+    ;
+  if(i > MAXORDER)
+    return 0;
+  r = kmem.free[i];
+  buddydel(r, i);
+  // give back the upper halves.
+  while(i > k){
+    kmem.nsplit[i]++;
+    i--;
+    buddypush((struct run*)((char*)r + (PGSIZE << i)), i);
+  }
+  kmem.nalloc[k]++;
+  return r;
+}
+
+// Free block pa of order k, merging it with its buddy for as
+// long as that is free too. Caller must hold kmem.lock.
+static void
+buddyfree(char *pa, int k)
+{
+  char *buddy;
+
+  for(; k < MAXORDER; k++){
+    buddy = (char*)((uint64)pa ^ (PGSIZE << k));
+    if(buddy < end || (uint64)buddy >= PHYSTOP || kmem.order[PA2PG(buddy)] != k + 1)
+      break;
+    buddydel((struct run*)buddy, k);
+    kmem.nmerge[k]++;
+    if(buddy < pa)
+      pa = buddy;
+  }
+  buddypush((struct run*)pa, k);
+}
+
+// Detach the first n pages of *list, at most, and return them;
+// *tail gets the last one and *got how many there are.
+static struct run*
+ktake(struct run **list, int n, struct run **tail, int *got)
+{
+  struct run *head = *list, *r = 0;
+  int i;
+
+  for(i = 0; i < n && *list; i++){
+    r = *list;
+    *list = r->next;
+  }
+  if(r)
+    r->next = 0;
+  *tail = r;
+  *got = i;
+  return i ? head : 0;
+}
+
+// Refill the cache of cpu c, which ran dry, and return a
+// page of the refill for the caller, or 0 if memory is out.
+// Caller must hold no kalloc lock.
+static struct run*
+krefill(struct kcache *c)
+{
+  struct run *batch = 0, *tail = 0, *r;
+  struct kcache *oc;
+  int n;
+
+  // the pages of one block lie together, and go back to it
+  // together; without one, take single pages.
+  acquire(&kmem.lock);
+  if((batch = buddyalloc(KBATCHORDER)) != 0){
+    for(n = 0; n < KBATCH; n++){
+      r = (struct run*)((char*)batch + n*PGSIZE);
+      r->next = n + 1 < KBATCH ? (struct run*)((char*)r + PGSIZE) : 0;
+    }
+    tail = r;
+  } else {
+    for(n = 0; n < KBATCH && (r = buddyalloc(0)) != 0; n++){
+      r->next = 0;
+      if(tail)
+        tail->next = r;
+      else
+        batch = r;
+      tail = r;
+    }
+  }
+  release(&kmem.lock);
+
+  for(oc = kcache; batch == 0 && oc < &kcache[NCPU]; oc++){
+    if(oc == c || oc->n == 0)
+      continue;
+    acquire(&oc->lock);
+    batch = ktake(&oc->freelist, (oc->n + 1) / 2, &tail, &n);
+    oc->n -= n;
+    release(&oc->lock);
+  }
+  if(batch == 0)
+    return 0;
+
+  r = batch;
+  if(--n > 0){
+    acquire(&c->lock);
+    tail->next = c->freelist;
+    c->freelist = r->next;
+    c->n += n;
+    release(&c->lock);
+  }
+  return r;
+}
+
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  for(struct kcache *c = kcache; c < &kcache[NCPU]; c++)
+    initlock(&c->lock, "kcache");
   freerange(end, (void*)PHYSTOP);
 }
 
+// hand the pages straight to the buddy allocator, which
+// merges them into blocks as large as their alignment allows.
 void
 freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  acquire(&kmem.lock);
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    memset(p, 1, PGSIZE);
+    buddyfree(p, 0);
+  }
+  release(&kmem.lock);
 }
 
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// call to kalloc().
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *batch = 0, *tail;
+  struct kcache *c;
+  int n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
@@ -56,10 +244,26 @@ kfree(void *pa)
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  if(++c->n > KHIGH){
+    batch = ktake(&c->freelist, KBATCH, &tail, &n);
+    c->n -= n;
+  }
+  release(&c->lock);
+  pop_off();
+
+  if(batch){
+    acquire(&kmem.lock);
+    for(r = batch; r; r = batch){
+      batch = r->next;
+      buddyfree((char*)r, 0);
+    }
+    release(&kmem.lock);
+  }
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +273,116 @@ void *
 kalloc(void)
 {
   struct run *r;
+  struct kcache *c;
+  struct proc *p;
+
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->n--;
+  }
+  release(&c->lock);
+  if(r == 0)
+    r = krefill(c);
+  pop_off();
+
+  if(r){
+    memset((char*)r, 5, PGSIZE); // fill with junk
+    if((p = myproc()) != 0)
+      p->pages++;
+  }
+  return (void*)r;
+}
+
+// Give every page in the per-cpu caches back to the buddy
+// allocator, so that they can merge into larger blocks.
+static void
+kdrain(void)
+{
+  struct kcache *c;
+  struct run *r, *batch;
 
+  for(c = kcache; c < &kcache[NCPU]; c++){
+    if(c->n == 0)
+      continue;
+    acquire(&c->lock);
+    batch = c->freelist;
+    c->freelist = 0;
+    c->n = 0;
+    release(&c->lock);
+
+    acquire(&kmem.lock);
+    for(r = batch; r; r = batch){
+      batch = r->next;
+      buddyfree((char*)r, 0);
+    }
+    release(&kmem.lock);
+  }
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size. Returns 0 if no such block is free, even with
+// the pages of the per-cpu caches merged back.
+void *
+kalloc_order(int order)
+{
+  struct run *r;
+  struct proc *p;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  r = buddyalloc(order);
   release(&kmem.lock);
+  if(r == 0){
+    kdrain();
+    acquire(&kmem.lock);
+    r = buddyalloc(order);
+    release(&kmem.lock);
+  }
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+  if(r){
+    memset((char*)r, 5, PGSIZE << order); // fill with junk
+    if((p = myproc()) != 0)
+      p->pages += 1 << order;
+  }
   return (void*)r;
 }
+
+// Free a block that kalloc_order(order) returned.
+void
+kfree_order(void *pa, int order)
+{
+  if(order < 0 || order > MAXORDER || ((uint64)pa % (PGSIZE << order)) != 0 ||
+     (char*)pa < end || (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_order");
+
+  memset(pa, 1, PGSIZE << order);
+
+  acquire(&kmem.lock);
+  buddyfree(pa, order);
+  release(&kmem.lock);
+}
+
+// Print the buddy allocator's per-order stats, on ^F.
+// Pages in the per-cpu caches are not counted as free.
+void
+kallocdump(void)
+{
+  struct kcache *c;
+  uint64 pages = 0;
+  int k, cached = 0;
+
+  printf("\norder free alloc split merge\n");
+  for(k = 0; k <= MAXORDER; k++){
+    printf("%d %d %d %d %d\n", k, kmem.nfree[k], (int)kmem.nalloc[k],
+           (int)kmem.nsplit[k], (int)kmem.nmerge[k]);
+    pages += (uint64)kmem.nfree[k] << k;
+  }
+  for(c = kcache; c < &kcache[NCPU]; c++)
+    cached += c->n;
+  printf("%d pages free, %d more in per-cpu caches\n", (int)pages, cached);
+}
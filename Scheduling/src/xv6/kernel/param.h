@@ -1,5 +1,8 @@
-#define NPROC        64  // maximum number of processes
+#ifndef NPROC
+#define NPROC       128  // maximum number of processes, `make NPROC=n`
+#endif
 #define NCPU          8  // maximum number of CPUs
+#define MAXORDER     10  // largest kalloc_order() block: 2^MAXORDER pages
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -4,20 +4,92 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "procinfo.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
 
+// One bit for each cpu that has entered scheduler().
+uint64 cpusonline;
+
 struct proc proc[NPROC];
 
 struct proc *initproc;
 
+// A min-heap of RUNNABLE processes, for the classes that pick
+// by a key instead of round-robin. All cpus share each heap,
+// so that shares and deadlines hold across cpus. lock is taken
+// after p->lock and is never held with a cpu's rqlock.
+struct procheap {
+  struct spinlock lock;
+  struct proc *heap[NPROC];
+  int n;
+  int (*less)(struct proc*, struct proc*);
+};
+
+// Processes holding tickets, the proportional-share class,
+// ordered by pass.
+#define STRIDE1 (1 << 20)
+#define STRIDE_MAXTICKETS 10000
+struct {
+  struct procheap h;
+  uint64 vtime;     // pass of the process picked last
+} stride;
+
+// Processes with a runtime, the deadline class, ordered by
+// absolute deadline, ahead of every other class. bw is the
+// sum of their densities, runtime / deadline in per-mille of
+// one cpu; admission keeps it below DL_MAXBW of each cpu,
+// see sched_setattr(). throttled lists the ones that used up
+// their budget, linked by rqnext, until dlreplenish() puts
+// them back when their next period starts. All under
+// dl.h.lock. Periods are limited to DL_MAXPERIOD ticks, so
+// that deadlines compare correctly as ticks wrap around.
+#define DL_MAXBW 950
+#define DL_MAXPERIOD (1 << 20)
+struct {
+  struct procheap h;
+  int bw;
+  struct proc *throttled;
+} dl;
+
+// Sleeping processes, hashed by channel, so that wakeup()
+// only looks at the processes sleeping on its channel and
+// the few that share its bucket. A bucket's lock is taken
+// after p->lock.
+#define NWAITQ 64
+#define WAKEUP_BATCH 16
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+} waitq[NWAITQ];
+
+// Unused proc[] slots, so that allocproc() need not look
+// for one. lock is taken after p->lock.
+struct {
+  struct spinlock lock;
+  struct proc *head;
+} freeprocs;
+
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// helps ensure that wakeups of wait()ing
+// parents are not lost. helps obey the
+// memory model when using p->parent and
+// the child lists. must be acquired
+// before any p->lock.
+struct spinlock wait_lock;
+
 extern void forkret(void);
-static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static int haveclones(struct proc *p);
+static void addchild(struct proc *p, struct proc *child);
+static void setrunnable(struct proc *p);
+static int mlfqbase(struct proc *p);
+static int strideless(struct proc *a, struct proc *b);
+static int dlless(struct proc *a, struct proc *b);
+static void dlunthrottle(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -45,10 +117,25 @@ procinit(void)
   struct proc *p;
   
   initlock(&pid_lock, "nextpid");
+  initlock(&wait_lock, "wait_lock");
+  initlock(&freeprocs.lock, "freeprocs");
+  initlock(&stride.h.lock, "stride");
+  stride.h.less = strideless;
+  initlock(&dl.h.lock, "deadline");
+  dl.h.less = dlless;
+  for(struct waitq *q = waitq; q < &waitq[NWAITQ]; q++)
+    initlock(&q->lock, "waitq");
+  for(struct cpu *c = cpus; c < &cpus[NCPU]; c++)
+    initlock(&c->rqlock, "runq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
   }
+  // hand out low slots first, like the scan used to.
+  for(p = &proc[NPROC-1]; p >= proc; p--){
+    p->freenext = freeprocs.head;
+    freeprocs.head = p;
+  }
 }
 
 // Must be called with interrupts disabled,
@@ -101,18 +188,30 @@ allocproc(void)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
-  }
-  return 0;
+  acquire(&freeprocs.lock);
+  p = freeprocs.head;
+  if(p)
+    freeprocs.head = p->freenext;
+  release(&freeprocs.lock);
+  if(p == 0)
+    return 0;
 
-found:
+  // freeproc() may still be holding it.
+  acquire(&p->lock);
   p->pid = allocpid();
+  // start on the creating cpu; idle cpus steal it if this one is busy.
+  p->cpu = cpuid();
+  p->nice = 0;
+  p->level = 0;
+  p->levelticks = 0;
+  p->tickets = 0;
+  p->dlruntime = 0;
+  p->dlthrottled = 0;
+  p->affinity = 0;
+  p->utime = p->stime = 0;
+  p->nvcsw = p->nivcsw = 0;
+  p->rblocks = p->wblocks = 0;
+  p->pages = 0;
 
   // for mp3
   p->thrdstop_ticks = 0;
@@ -128,6 +227,7 @@ found:
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    freeproc(p);
     release(&p->lock);
     return 0;
   }
@@ -158,17 +258,30 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
+  if(p->pagetable){
+    if(p->isthread){
+      // the memory belongs to the process that cloned us.
+      uvmunmap(p->pagetable, 0, PGROUNDUP(p->sz)/PGSIZE, 0);
+      proc_freepagetable(p->pagetable, 0);
+    } else
+      proc_freepagetable(p->pagetable, p->sz);
+  }
   p->pagetable = 0;
   p->sz = 0;
   p->pid = 0;
+  p->isthread = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
+  p->wqchan = 0;
   p->killed = 0;
   p->xstate = 0;
   p->state = UNUSED;
+
+  acquire(&freeprocs.lock);
+  p->freenext = freeprocs.head;
+  freeprocs.head = p;
+  release(&freeprocs.lock);
 }
 
 // Create a user page table for a given process,
@@ -247,7 +360,7 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
@@ -260,6 +373,11 @@ growproc(int n)
   uint sz;
   struct proc *p = myproc();
 
+  // memory shared by clone() can not be resized, since
+  // the other page tables would not see the change.
+  if(p->isthread || haveclones(p))
+    return -1;
+
   sz = p->sz;
   if(n > 0){
     if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
@@ -294,7 +412,12 @@ fork(void)
   }
   np->sz = p->sz;
 
-  np->parent = p;
+  np->nice = p->nice;
+  np->level = mlfqbase(np);
+  np->tickets = p->tickets;
+  np->stride = p->stride;
+  np->pass = p->pass;
+  np->affinity = p->affinity;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -312,37 +435,184 @@ fork(void)
 
   pid = np->pid;
 
-  np->state = RUNNABLE;
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  addchild(p, np);
+  release(&wait_lock);
 
+  acquire(&np->lock);
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
+// Create a new process sharing the parent's memory, a
+// kernel thread for user code. It starts at fn(arg) on
+// the user stack `stack`, with `tp` in its tp register.
+// Returns the child's pid, which the parent can wait() for.
+int
+clone(uint64 fn, uint64 arg, uint64 stack, uint64 tp)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if(stack == 0 || stack > p->sz || fn >= p->sz)
+    return -1;
+
+  // Allocate process.
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+
+  // Map the parent's memory, without copying it.
+  if(uvmshare(p->pagetable, np->pagetable, p->sz) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->sz = p->sz;
+  np->isthread = 1;
+
+  np->nice = p->nice;
+  np->level = mlfqbase(np);
+  np->tickets = p->tickets;
+  np->stride = p->stride;
+  np->pass = p->pass;
+  np->affinity = p->affinity;
+
+  // start at fn(arg); if fn returns, it jumps to 0 and faults,
+  // so it should call exit().
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  np->trapframe->tp = tp;
+  np->trapframe->ra = 0;
+
+  // increment reference counts on open file descriptors.
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  addchild(p, np);
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Make p the parent of child, at the head of its children.
+// Caller must hold wait_lock.
+static void
+addchild(struct proc *p, struct proc *child)
+{
+  child->parent = p;
+  child->prevsibling = 0;
+  child->sibling = p->children;
+  if(p->children)
+    p->children->prevsibling = child;
+  p->children = child;
+}
+
+// Take child off its parent's children.
+// Caller must hold wait_lock.
+static void
+delchild(struct proc *child)
+{
+  if(child->prevsibling)
+    child->prevsibling->sibling = child->sibling;
+  else
+    child->parent->children = child->sibling;
+  if(child->sibling)
+    child->sibling->prevsibling = child->prevsibling;
+  child->parent = 0;
+  child->sibling = child->prevsibling = 0;
+}
+
+// 1 if some process created by p's clone() has not
+// been freed yet.
+static int
+haveclones(struct proc *p)
+{
+  struct proc *pp;
+  int found = 0;
+
+  acquire(&wait_lock);
+  for(pp = p->children; pp; pp = pp->sibling){
+    if(pp->isthread){
+      found = 1;
+      break;
+    }
+  }
+  release(&wait_lock);
+  return found;
+}
+
+// Kill the processes created by p's clone() and wait
+// until they are zombies, since freeing p frees the
+// memory they run in.
+void
+killclones(struct proc *p)
+{
+  struct proc *pp;
+  int alive;
+
+  acquire(&wait_lock);
+  for(;;){
+    alive = 0;
+    for(pp = p->children; pp; pp = pp->sibling){
+      if(pp->isthread){
+        acquire(&pp->lock);
+        if(pp->state != ZOMBIE){
+          alive = 1;
+          pp->killed = 1;
+          if(pp->state == SLEEPING){
+            // Wake process from sleep().
+            setrunnable(pp);
+          } else if(pp->dlthrottled){
+            dlunthrottle(pp);
+          }
+        }
+        release(&pp->lock);
+      }
+    }
+    if(!alive)
+      break;
+    // an exiting child wakes us up.
+    sleep(p, &wait_lock);
+  }
+  release(&wait_lock);
+}
+
 // Pass p's abandoned children to init.
-// Caller must hold p->lock.
+// Caller must hold wait_lock.
 void
 reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    // this code uses pp->parent without holding pp->lock.
-    // acquiring the lock first could cause a deadlock
-    // if pp or a child of pp were also in exit()
-    // and about to try to lock p.
-    if(pp->parent == p){
-      // pp->parent can't change between the check and the acquire()
-      // because only the parent changes it, and we're the parent.
-      acquire(&pp->lock);
-      pp->parent = initproc;
-      // we should wake up init here, but that would require
-      // initproc->lock, which would be a deadlock, since we hold
-      // the lock on one of init's children (pp). this is why
-      // exit() always wakes init (before acquiring any locks).
-      release(&pp->lock);
-    }
+  if(p->children == 0)
+    return;
+  while((pp = p->children) != 0){
+    delchild(pp);
+    addchild(initproc, pp);
   }
+  // some of them may be zombies already.
+  wakeup(initproc);
 }
 
 // Exit the current process.  Does not return.
@@ -356,6 +626,11 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  killclones(p);
+
+  // give back its deadline reservation.
+  sched_setattr(0, 0, 0);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -370,41 +645,20 @@ exit(int status)
   end_op();
   p->cwd = 0;
 
-  // we might re-parent a child to init. we can't be precise about
-  // waking up init, since we can't acquire its lock once we've
-  // acquired any other proc lock. so wake up init whether that's
-  // necessary or not. init may miss this wakeup, but that seems
-  // harmless.
-  acquire(&initproc->lock);
-  wakeup1(initproc);
-  release(&initproc->lock);
-
-  // grab a copy of p->parent, to ensure that we unlock the same
-  // parent we locked. in case our parent gives us away to init while
-  // we're waiting for the parent lock. we may then race with an
-  // exiting parent, but the result will be a harmless spurious wakeup
-  // to a dead or wrong process; proc structs are never re-allocated
-  // as anything else.
-  acquire(&p->lock);
-  struct proc *original_parent = p->parent;
-  release(&p->lock);
-  
-  // we need the parent's lock in order to wake it up from wait().
-  // the parent-then-child rule says we have to lock it first.
-  acquire(&original_parent->lock);
-
-  acquire(&p->lock);
+  acquire(&wait_lock);
 
   // Give any children to init.
   reparent(p);
 
   // Parent might be sleeping in wait().
-  wakeup1(original_parent);
+  wakeup(p->parent);
+
+  acquire(&p->lock);
 
   p->xstate = status;
   p->state = ZOMBIE;
 
-  release(&original_parent->lock);
+  release(&wait_lock);
 
   // Jump into the scheduler, never to return.
   sched();
@@ -420,55 +674,765 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
-  // hold p->lock for the whole time to avoid lost
+  // hold wait_lock for the whole time to avoid lost
   // wakeups from a child's exit().
-  acquire(&p->lock);
+  acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      // this code uses np->parent without holding np->lock.
-      // acquiring the lock first would cause a deadlock,
-      // since np might be an ancestor, and we already hold p->lock.
-      if(np->parent == p){
-        // np->parent can't change between the check and the acquire()
-        // because only the parent changes it, and we're the parent.
-        acquire(&np->lock);
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&p->lock);
-            return -1;
-          }
-          freeproc(np);
+    for(np = p->children; np; np = np->sibling){
+      acquire(&np->lock);
+      havekids = 1;
+      if(np->state == ZOMBIE){
+        // Found one.
+        pid = np->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                sizeof(np->xstate)) < 0) {
           release(&np->lock);
-          release(&p->lock);
-          return pid;
+          release(&wait_lock);
+          return -1;
         }
+        delchild(np);
+        freeproc(np);
         release(&np->lock);
+        release(&wait_lock);
+        return pid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
     if(!havekids || p->killed){
-      release(&p->lock);
+      release(&wait_lock);
       return -1;
     }
     
     // Wait for a child to exit.
-    sleep(p, &p->lock);  //DOC: wait-sleep
+    sleep(p, &wait_lock);  //DOC: wait-sleep
   }
 }
 
 // Per-CPU process scheduler.
+// The run queues form a multilevel feedback queue. A process
+// that uses up the allotment of its level moves one level down,
+// one that wakes up from sleep moves one level up, and every
+// MLFQ_BOOST ticks all processes go back to their base level so
+// that none starves. nice sets the range of levels:
+//
+//   nice < 0:  levels 0-1, never below interactive work
+//   nice = 0:  levels 0-2
+//   nice > 0:  levels 1-3, level 3 only runs when nothing else can
+#define MLFQ_BOOST 100
+static int mlfq_allot[NMLFQ] = { 1, 2, 4, 8 };
+
+static int
+mlfqbase(struct proc *p)
+{
+  return p->nice > 0 ? 1 : 0;
+}
+
+static int
+mlfqfloor(struct proc *p)
+{
+  if(p->nice < 0)
+    return 1;
+  return p->nice > 0 ? NMLFQ-1 : NMLFQ-2;
+}
+
+// May p run on cpu c? An unlocked read of p->affinity when
+// c steals p, which at worst lets p run once more where
+// setaffinity() just took it off.
+static int
+cpuallowed(struct proc *p, struct cpu *c)
+{
+  return p->affinity == 0 || (p->affinity & (1L << (c - cpus)));
+}
+
+// Insert p into h. Caller must hold h->lock.
+static void
+heapput(struct procheap *h, struct proc *p)
+{
+  int i, parent;
+
+  for(i = h->n++; i > 0; i = parent){
+    parent = (i - 1) / 2;
+    if(!h->less(p, h->heap[parent]))
+      break;
+    h->heap[i] = h->heap[parent];
+  }
+  h->heap[i] = p;
+}
+
+// Index of the smallest process in h that cpu me may run,
+// or -1. Pinned processes are rare, so usually that is the
+// root; otherwise look past the ones me may not run, so
+// that they do not hold up the rest of the heap on every
+// other cpu. Caller must hold h->lock.
+static int
+heapfind(struct procheap *h, struct cpu *me)
+{
+  int i, best = -1;
+
+  if(h->n > 0 && cpuallowed(h->heap[0], me))
+    return 0;
+  for(i = 1; i < h->n; i++){
+    if(cpuallowed(h->heap[i], me) &&
+       (best < 0 || h->less(h->heap[i], h->heap[best])))
+      best = i;
+  }
+  return best;
+}
+
+// Take the smallest process cpu me may run off h, or
+// return 0. Caller must hold h->lock.
+static struct proc*
+heapget(struct procheap *h, struct cpu *me)
+{
+  struct proc *p, *last;
+  int i, child;
+
+  if((i = heapfind(h, me)) < 0)
+    return 0;
+  p = h->heap[i];
+  last = h->heap[--h->n];
+  if(i == h->n)
+    return p;
+  // fill the hole at i with the last entry: up if it is
+  // smaller than the hole's parent, else down.
+  for(; i > 0 && h->less(last, h->heap[(i - 1) / 2]); i = (i - 1) / 2)
+    h->heap[i] = h->heap[(i - 1) / 2];
+  for(; (child = 2*i + 1) < h->n; i = child){
+    if(child + 1 < h->n && h->less(h->heap[child+1], h->heap[child]))
+      child++;
+    if(!h->less(h->heap[child], last))
+      break;
+    h->heap[i] = h->heap[child];
+  }
+  h->heap[i] = last;
+  return p;
+}
+
+static int
+strideless(struct proc *a, struct proc *b)
+{
+  return a->pass < b->pass || (a->pass == b->pass && a->pid < b->pid);
+}
+
+// Insert p into the stride heap. A process coming back from
+// sleep resumes at the current virtual time, so sleeping does
+// not bank a bigger share for later. Caller must hold p->lock.
+static void
+strideput(struct proc *p)
+{
+  acquire(&stride.h.lock);
+  if(p->pass < stride.vtime)
+    p->pass = stride.vtime;
+  heapput(&stride.h, p);
+  release(&stride.h.lock);
+}
+
+// Take the process with the smallest pass for cpu me, or 0.
+static struct proc*
+strideget(struct cpu *me)
+{
+  struct proc *p;
+
+  // an unlocked peek, like runqpop().
+  if(stride.h.n == 0)
+    return 0;
+  acquire(&stride.h.lock);
+  if((p = heapget(&stride.h, me)) != 0)
+    stride.vtime = p->pass;
+  release(&stride.h.lock);
+  return p;
+}
+
+static int
+dlless(struct proc *a, struct proc *b)
+{
+  return (int)(a->dlabs - b->dlabs) < 0 ||
+         (a->dlabs == b->dlabs && a->pid < b->pid);
+}
+
+// Insert p into the deadline heap. Caller must hold p->lock.
+static void
+dlput(struct proc *p)
+{
+  acquire(&dl.h.lock);
+  heapput(&dl.h, p);
+  release(&dl.h.lock);
+}
+
+// Take the process with the earliest deadline for cpu me, or 0.
+static struct proc*
+dlget(struct cpu *me)
+{
+  struct proc *p;
+
+  if(dl.h.n == 0)
+    return 0;
+  acquire(&dl.h.lock);
+  p = heapget(&dl.h, me);
+  release(&dl.h.lock);
+  return p;
+}
+
+// Start of the period after p's current one, whose deadline
+// is dlabs. Caller must hold p->lock or dl.h.lock, with p not
+// running.
+static uint
+dlnext(struct proc *p)
+{
+  return p->dlabs - p->dldeadline + p->dlperiod;
+}
+
+// Give p its next period and a full budget. It starts at
+// dlnext(p), so that p gets runtime per period even with a
+// deadline shorter than the period; or now, if p is too late
+// to meet that period's deadline, or comes back early to exit.
+// Caller must hold p->lock.
+static void
+dlnewperiod(struct proc *p)
+{
+  uint start = dlnext(p);
+
+  if((int)(ticks - start) < 0 || (int)(ticks - (start + p->dldeadline)) >= 0)
+    start = ticks;
+  p->dlabs = start + p->dldeadline;
+  p->dlbudget = p->dlruntime;
+}
+
+// p used up its budget before its next period: keep it off
+// the deadline heap until then, RUNNABLE but on no run queue.
+// Caller must hold p->lock.
+static void
+dlthrottle(struct proc *p)
+{
+  p->dlthrottled = 1;
+  acquire(&dl.h.lock);
+  p->rqnext = dl.throttled;
+  dl.throttled = p;
+  release(&dl.h.lock);
+}
+
+// Append p to the run queue of cpu p->cpu for its level.
+// p stays on the cpu it last ran on, where its cache and
+// TLB entries are warm, unless its affinity rules that cpu
+// out; then it moves to the least loaded online cpu it may
+// use. setaffinity() keeps the affinity within the online
+// cpus, so there always is one. Caller must hold p->lock.
+static void
+runqput(struct proc *p)
+{
+  struct cpu *c = &cpus[p->cpu];
+  struct cpu *oc;
+  uint epoch = ticks / MLFQ_BOOST;
+
+  if(!cpuallowed(p, c)){
+    c = 0;
+    for(oc = cpus; oc < &cpus[NCPU]; oc++){
+      if((cpusonline & (1L << (oc - cpus))) && cpuallowed(p, oc) &&
+         (c == 0 || oc->nrunnable < c->nrunnable))
+        c = oc;
+    }
+    if(c == 0)
+      panic("runqput: no cpu");
+    p->cpu = c - cpus;
+  }
+
+  if(p->dlruntime){
+    dlput(p);
+    return;
+  }
+  if(p->tickets){
+    strideput(p);
+    return;
+  }
+  if(p->epoch != epoch){
+    p->epoch = epoch;
+    p->level = mlfqbase(p);
+    p->levelticks = 0;
+  }
+
+  acquire(&c->rqlock);
+  p->rqnext = 0;
+  if(c->rqtail[p->level])
+    c->rqtail[p->level]->rqnext = p;
+  else
+    c->rqhead[p->level] = p;
+  c->rqtail[p->level] = p;
+  c->nrunnable++;
+  release(&c->rqlock);
+}
+
+// Move every process queued on c to its base level queue.
+// Their level fields are reset by runqput() the next time
+// they are queued. Caller must hold c->rqlock.
+static void
+runqboost(struct cpu *c)
+{
+  struct proc *p, *next;
+  struct proc *head[NMLFQ], *tail[NMLFQ];
+  int i, lvl;
+
+  for(i = 0; i < NMLFQ; i++)
+    head[i] = tail[i] = 0;
+  for(i = 0; i < NMLFQ; i++){
+    for(p = c->rqhead[i]; p; p = next){
+      next = p->rqnext;
+      // an unlocked read of p->nice: a racing setpriority()
+      // only changes which queue p waits in.
+      lvl = mlfqbase(p);
+      p->rqnext = 0;
+      if(tail[lvl])
+        tail[lvl]->rqnext = p;
+      else
+        head[lvl] = p;
+      tail[lvl] = p;
+    }
+  }
+  for(i = 0; i < NMLFQ; i++){
+    c->rqhead[i] = head[i];
+    c->rqtail[i] = tail[i];
+  }
+}
+
+// Take the oldest process of the highest non-empty level
+// in [lo, hi) off c's run queues, or return 0. When cpu me
+// steals from c, skip the processes it may not run.
+static struct proc*
+runqpop(struct cpu *c, int lo, int hi, struct cpu *me)
+{
+  struct proc *p = 0, *prev;
+  uint epoch;
+  int i;
+
+  // an unlocked peek, so that idle cpus looking for work
+  // do not contend on every queue's lock.
+  if(c->nrunnable == 0)
+    return 0;
+  acquire(&c->rqlock);
+  epoch = ticks / MLFQ_BOOST;
+  if(c->rqepoch != epoch){
+    c->rqepoch = epoch;
+    runqboost(c);
+  }
+  for(i = lo; i < hi; i++){
+    prev = 0;
+    for(p = c->rqhead[i]; p; prev = p, p = p->rqnext){
+      if(c == me || cpuallowed(p, me))
+        break;
+    }
+    if(p){
+      if(prev)
+        prev->rqnext = p->rqnext;
+      else
+        c->rqhead[i] = p->rqnext;
+      if(c->rqtail[i] == p)
+        c->rqtail[i] = prev;
+      p->rqnext = 0;
+      c->nrunnable--;
+      break;
+    }
+  }
+  release(&c->rqlock);
+  return p;
+}
+
+// Pick the next process for c, or return 0: the deadline
+// class first, earliest deadline first; then processes at
+// MLFQ level 0, which just woke up or have barely run, to
+// keep interactive work responsive; then the
+// proportional-share class; then the rest of the MLFQ.
+static struct proc*
+runqget(struct cpu *c, struct cpu *me)
+{
+  struct proc *p;
+
+  if((p = dlget(me)) == 0 && (p = runqpop(c, 0, 1, me)) == 0 &&
+     (p = strideget(me)) == 0)
+    p = runqpop(c, 1, NMLFQ, me);
+  return p;
+}
+
+// Send an inter-processor interrupt to cpu c, to get it out
+// of wfi.
+static void
+ipi(struct cpu *c)
+{
+  *(uint32*)CLINT_MSIP(c - cpus) = 1;
+}
+
+// Make sure some cpu will look at p, just queued on cpu
+// p->cpu: that cpu if it is idle, or else any idle cpu p may
+// run on, which will steal it; busy cpus look again at their
+// next tick anyway.
+static void
+kick(struct proc *p)
+{
+  struct cpu *c = &cpus[p->cpu];
+  struct cpu *oc;
+
+  // pairs with the barrier in idle(): either the idle cpu
+  // sees the new work before its wfi, or we see it idle.
+  __sync_synchronize();
+  if(c->idle){
+    ipi(c);
+    return;
+  }
+  for(oc = cpus; oc < &cpus[NCPU]; oc++){
+    if(oc->idle && cpuallowed(p, oc)){
+      ipi(oc);
+      return;
+    }
+  }
+}
+
+// Take a process cpu me may run off the run queues of the
+// other cpus, the busiest first, or return 0.
+static struct proc*
+steal(struct cpu *me)
+{
+  struct cpu *victim = 0, *oc;
+  struct proc *p;
+
+  for(oc = cpus; oc < &cpus[NCPU]; oc++){
+    if(oc != me && oc->nrunnable > 0 &&
+       (victim == 0 || oc->nrunnable > victim->nrunnable))
+      victim = oc;
+  }
+  if(victim == 0)
+    return 0;
+  if((p = runqpop(victim, 0, NMLFQ, me)) != 0)
+    return p;
+  // the busiest cpu may only have processes pinned to it.
+  for(oc = cpus; oc < &cpus[NCPU]; oc++){
+    if(oc != me && oc != victim && (p = runqpop(oc, 0, NMLFQ, me)) != 0)
+      return p;
+  }
+  return 0;
+}
+
+// Does h hold a process cpu me may run?
+static int
+heapany(struct procheap *h, struct cpu *me)
+{
+  int any;
+
+  if(h->n == 0)
+    return 0;
+  acquire(&h->lock);
+  any = heapfind(h, me) >= 0;
+  release(&h->lock);
+  return any;
+}
+
+// Does c have a queued process cpu me may run?
+static int
+runqany(struct cpu *c, struct cpu *me)
+{
+  struct proc *p = 0;
+  int i;
+
+  if(c->nrunnable == 0)
+    return 0;
+  if(c == me)
+    return 1;
+  acquire(&c->rqlock);
+  for(i = 0; i < NMLFQ && p == 0; i++){
+    for(p = c->rqhead[i]; p; p = p->rqnext){
+      if(cpuallowed(p, me))
+        break;
+    }
+  }
+  release(&c->rqlock);
+  return p != 0;
+}
+
+// Give p, taken off dl.throttled, its next period and queue
+// it again. Caller must hold p->lock.
+static void
+dlrenew(struct proc *p)
+{
+  p->dlthrottled = 0;
+  dlnewperiod(p);
+  runqput(p);
+  kick(p);
+}
+
+// Let a throttled p run before its next period, to exit; unless
+// dlreplenish() has just taken it off the list, and will
+// queue it. Caller must hold p->lock.
+static void
+dlunthrottle(struct proc *p)
+{
+  struct proc **pp;
+  int found = 0;
+
+  acquire(&dl.h.lock);
+  for(pp = &dl.throttled; *pp; pp = &(*pp)->rqnext){
+    if(*pp == p){
+      *pp = p->rqnext;
+      found = 1;
+      break;
+    }
+  }
+  release(&dl.h.lock);
+  if(found)
+    dlrenew(p);
+}
+
+// Called by clockintr() every tick: queue again the throttled
+// processes whose next period has come. They are not running,
+// so their dlabs holds still without p->lock.
+void
+dlreplenish(void)
+{
+  struct proc *p, **pp, *due = 0;
+
+  // an unlocked peek, like runqpop().
+  if(dl.throttled == 0)
+    return;
+  acquire(&dl.h.lock);
+  for(pp = &dl.throttled; (p = *pp) != 0; ){
+    if((int)(ticks - dlnext(p)) >= 0){
+      *pp = p->rqnext;
+      p->rqnext = due;
+      due = p;
+    } else
+      pp = &p->rqnext;
+  }
+  release(&dl.h.lock);
+  while((p = due) != 0){
+    due = p->rqnext;
+    // p may still be switching out on the cpu that
+    // throttled it, which holds p->lock until it is done.
+    acquire(&p->lock);
+    dlrenew(p);
+    release(&p->lock);
+  }
+}
+
+// Is anything waiting that cpu me may run? For idle(), so it
+// must agree with what runqget() and steal() can pick: work
+// pinned to other cpus does not keep me out of wfi.
+static int
+anyrunnable(struct cpu *me)
+{
+  struct cpu *c;
+
+  if(heapany(&dl.h, me) || heapany(&stride.h, me))
+    return 1;
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(runqany(c, me))
+      return 1;
+  }
+  return 0;
+}
+
+// Nothing to run or steal: stop the hart in wfi until an
+// interrupt, a device's, its own timer's or an IPI from
+// kick(), instead of spinning through the run queues.
+// Interrupts stay off around the check and the wfi so that
+// an IPI that arrives in between is still pending, and
+// ends the wfi at once, instead of being handled and lost;
+// wfi does not need them enabled to wake up.
+static void
+idle(struct cpu *c)
+{
+  intr_off();
+  c->idle = 1;
+  __sync_synchronize();
+  if(!anyrunnable(c))
+    asm volatile("wfi");
+  c->idle = 0;
+  intr_on();
+}
+
+// Mark p RUNNABLE and queue it on the cpu it last ran on.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  int yielding = p->state == RUNNING;
+
+  if(p->state == SLEEPING && p->level > mlfqbase(p)){
+    // it gave up the cpu before its allotment ran out.
+    p->level--;
+    p->levelticks = 0;
+  }
+  if(p->state == SLEEPING && p->dlruntime){
+    // the CBS wakeup rule: keep the deadline unless it has
+    // passed or the budget left would run faster than the
+    // reserved bandwidth until it; then start a new period.
+    uint now = ticks;
+    if((int)(now - p->dlabs) >= 0 ||
+       (uint64)p->dlbudget * p->dlperiod > (uint64)p->dlruntime * (p->dlabs - now)){
+      p->dlabs = now + p->dldeadline;
+      p->dlbudget = p->dlruntime;
+    }
+  }
+  p->state = RUNNABLE;
+  runqput(p);
+  // a yielding process is about to be picked again by its
+  // own cpu, unless something better is waiting there.
+  if(!yielding)
+    kick(p);
+}
+
+// Let process pid, or the caller if pid is 0, run only on
+// the cpus in mask, one bit per cpu; 0 lets it run anywhere.
+// Without a mask a process still prefers the cpu it last ran
+// on. A running or queued process moves the next time it is
+// queued. Returns -1 if no cpu in mask is running.
+int
+setaffinity(int pid, uint64 mask)
+{
+  struct proc *p;
+
+  if(mask != 0 && (mask & cpusonline) == 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      p->affinity = mask & cpusonline;
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+// Density of a reservation, runtime / deadline in per-mille
+// of a cpu, rounded up; at most 1000, as runtime <= deadline.
+static int
+dlbw(int runtime, int deadline)
+{
+  if(runtime == 0)
+    return 0;
+  return ((uint64)runtime * 1000 + deadline - 1) / deadline;
+}
+
+// Join the deadline class: run for up to runtime ticks in
+// every period, within deadline ticks (0 for period) of its
+// start. Or leave it, if runtime is 0. Returns -1 if the
+// arguments are out of range, the period longer than
+// DL_MAXPERIOD, or admission control refuses the reservation.
+//
+// The deadline heap is global EDF on m online cpus, where
+// a total utilization below m is not enough: one heavy task
+// can miss next to light ones (the Dhall effect). Admit a
+// set only if it passes the GFB test on densities,
+// sum <= m - (m-1) * max, and the densities also stay under
+// DL_MAXBW of each cpu, to leave some time to the rest.
+int
+sched_setattr(int runtime, int period, int deadline)
+{
+  struct proc *p = myproc();
+  struct proc *pp;
+  int bw, oldbw, maxbw, b, online = 0;
+  uint64 m;
+
+  if(deadline == 0)
+    deadline = period;
+  if(runtime < 0 || (runtime > 0 && (runtime > deadline || deadline > period ||
+                                     period > DL_MAXPERIOD)))
+    return -1;
+  bw = dlbw(runtime, deadline);
+  for(m = cpusonline; m; m >>= 1)
+    online += m & 1;
+
+  acquire(&p->lock);
+  oldbw = dlbw(p->dlruntime, p->dldeadline);
+  acquire(&dl.h.lock);
+  if(bw > oldbw){
+    // dlruntime and dldeadline only change under dl.h.lock.
+    maxbw = bw;
+    for(pp = proc; pp < &proc[NPROC]; pp++){
+      if(pp != p && (b = dlbw(pp->dlruntime, pp->dldeadline)) > maxbw)
+        maxbw = b;
+    }
+    if(dl.bw - oldbw + bw > 1000 * online - (online - 1) * maxbw ||
+       dl.bw - oldbw + bw > DL_MAXBW * online){
+      release(&dl.h.lock);
+      release(&p->lock);
+      return -1;
+    }
+  }
+  dl.bw += bw - oldbw;
+  // p is running, so it is in no heap or queue now.
+  p->dlruntime = runtime;
+  p->dlperiod = period;
+  p->dldeadline = deadline;
+  release(&dl.h.lock);
+  p->dlabs = ticks + deadline;
+  p->dlbudget = runtime;
+  release(&p->lock);
+  return 0;
+}
+
+// Join the proportional-share class with n tickets, or go
+// back to time-sharing if n is 0. Returns -1 if n is out
+// of range.
+int
+settickets(int n)
+{
+  struct proc *p = myproc();
+
+  if(n < 0 || n > STRIDE_MAXTICKETS)
+    return -1;
+  acquire(&p->lock);
+  if(n > 0 && p->tickets == 0){
+    // start level with the processes already in the class.
+    p->pass = stride.vtime;
+  }
+  p->tickets = n;
+  p->stride = n ? STRIDE1 / n : 0;
+  release(&p->lock);
+  return 0;
+}
+
+// Set the nice value of process pid, or of the caller if pid
+// is 0. The new range of levels applies from its next wait
+// in a run queue. Returns 0, or -1 if there is no such process.
+int
+setpriority(int pid, int nice)
+{
+  struct proc *p;
+
+  if(nice < -20)
+    nice = -20;
+  if(nice > 19)
+    nice = 19;
+  if(pid == 0)
+    pid = myproc()->pid;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      p->nice = nice;
+      if(p->level < mlfqbase(p))
+        p->level = mlfqbase(p);
+      if(p->level > mlfqfloor(p))
+        p->level = mlfqfloor(p);
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose a process to run: the oldest at the highest
+//    level on this cpu's run queues, or else one stolen
+//    from the busiest cpu, or else wait in idle().
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -479,26 +1443,34 @@ scheduler(void)
   struct cpu *c = mycpu();
   
   c->proc = 0;
+  __sync_fetch_and_or(&cpusonline, 1L << (c - cpus));
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
+    if((p = runqget(c, c)) == 0 && (p = steal(c)) == 0){
+      idle(c);
+      continue;
+    }
+
+    // p is off every run queue, so no other cpu can pick it;
+    // it may still be switching out on the cpu that queued it,
+    // which holds p->lock until it is done.
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      p->cpu = c - cpus;
+      c->proc = p;
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
     }
+    release(&p->lock);
   }
 }
 
@@ -530,12 +1502,35 @@ sched(void)
 }
 
 // Give up the CPU for one scheduling round.
+// Called on every timer tick, which is charged to
+// the allotment of the process's MLFQ level.
 void
 yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  p->nivcsw++;
+  if(p->dlruntime){
+    if(--p->dlbudget <= 0){
+      if((int)(ticks - dlnext(p)) < 0 && !p->killed){
+        // out of budget: throttled until its next period.
+        p->state = RUNNABLE;
+        dlthrottle(p);
+        sched();
+        release(&p->lock);
+        return;
+      }
+      // the next period has come already.
+      dlnewperiod(p);
+    }
+  } else if(p->tickets){
+    p->pass += p->stride;
+  } else if(++p->levelticks >= mlfq_allot[p->level]){
+    if(p->level < mlfqfloor(p))
+      p->level++;
+    p->levelticks = 0;
+  }
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -561,6 +1556,52 @@ forkret(void)
   usertrapret();
 }
 
+static struct waitq*
+waitqof(void *chan)
+{
+  uint64 x = (uint64)chan;
+
+  // channels are addresses of kernel objects: drop the
+  // alignment bits and fold in the page number.
+  return &waitq[((x >> 3) ^ (x >> 12)) % NWAITQ];
+}
+
+// Take p off wait queue q. Caller must hold q->lock.
+static void
+waitqdel(struct waitq *q, struct proc *p)
+{
+  if(p->wqprev)
+    p->wqprev->wqnext = p->wqnext;
+  else
+    q->head = p->wqnext;
+  if(p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  p->wqchan = 0;
+}
+
+// Add p to the wait queue of chan, or, if chan is 0, take
+// it off the one of p->chan unless wakeup() already did.
+// Caller must hold p->lock.
+static void
+waitqset(struct proc *p, void *chan)
+{
+  struct waitq *q = waitqof(chan ? chan : p->chan);
+
+  acquire(&q->lock);
+  if(chan == 0){
+    if(p->wqchan)
+      waitqdel(q, p);
+  } else {
+    p->wqchan = chan;
+    p->wqprev = 0;
+    p->wqnext = q->head;
+    if(q->head)
+      q->head->wqprev = p;
+    q->head = p;
+  }
+  release(&q->lock);
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -573,19 +1614,24 @@ sleep(void *chan, struct spinlock *lk)
   // Once we hold p->lock, we can be
   // guaranteed that we won't miss any wakeup
   // (wakeup locks p->lock),
-  // so it's okay to release lk.
-  if(lk != &p->lock){  //DOC: sleeplock0
+  // so it's okay to release lk. wakeup() finds
+  // sleepers in the wait queues, so p joins the
+  // one of chan before lk goes.
+  if(lk != &p->lock)  //DOC: sleeplock0
     acquire(&p->lock);  //DOC: sleeplock1
+  waitqset(p, chan);
+  if(lk != &p->lock)
     release(lk);
-  }
 
   // Go to sleep.
+  p->nvcsw++;
   p->chan = chan;
   p->state = SLEEPING;
 
   sched();
 
-  // Tidy up.
+  // Tidy up. kill() leaves p in the wait queue.
+  waitqset(p, 0);
   p->chan = 0;
 
   // Reacquire original lock.
@@ -600,27 +1646,35 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
-
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == SLEEPING && p->chan == chan) {
-      p->state = RUNNABLE;
+  struct waitq *q = waitqof(chan);
+  struct proc *p, *next, *waiters[WAKEUP_BATCH];
+  int i, n;
+
+  // p->lock comes before the queue's lock, so take the
+  // waiters off the queue first, a batch at a time to keep
+  // the kernel stack small. Some may be awake already, on
+  // their way out of sleep().
+  do {
+    n = 0;
+    acquire(&q->lock);
+    for(p = q->head; p && n < WAKEUP_BATCH; p = next){
+      next = p->wqnext;
+      if(p->wqchan == chan){
+        waitqdel(q, p);
+        waiters[n++] = p;
+      }
     }
-    release(&p->lock);
-  }
-}
+    release(&q->lock);
 
-// Wake up p if it is sleeping in wait(); used by exit().
-// Caller must hold p->lock.
-static void
-wakeup1(struct proc *p)
-{
-  if(!holding(&p->lock))
-    panic("wakeup1");
-  if(p->chan == p && p->state == SLEEPING) {
-    p->state = RUNNABLE;
-  }
+    for(i = 0; i < n; i++){
+      p = waiters[i];
+      acquire(&p->lock);
+      if(p->state == SLEEPING && p->chan == chan) {
+        setrunnable(p);
+      }
+      release(&p->lock);
+    }
+  } while(n == WAKEUP_BATCH);
 }
 
 // Kill the process with the given pid.
@@ -637,7 +1691,9 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        setrunnable(p);
+      } else if(p->dlthrottled){
+        dlunthrottle(p);
       }
       release(&p->lock);
       return 0;
@@ -647,6 +1703,52 @@ kill(int pid)
   return -1;
 }
 
+// Fill in *pi for the process with the smallest pid at
+// least pid, so that callers can walk all processes, and
+// return its pid; -1 if there is none.
+int
+getprocinfo(int pid, struct procinfo *pi)
+{
+  struct proc *p, *found = 0;
+
+  // processes are only freed under wait_lock, and it
+  // keeps p->parent still.
+  acquire(&wait_lock);
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->state != UNUSED && p->pid >= pid && (found == 0 || p->pid < found->pid))
+      found = p;
+    release(&p->lock);
+  }
+  if(found == 0){
+    release(&wait_lock);
+    return -1;
+  }
+
+  p = found;
+  acquire(&p->lock);
+  pi->pid = p->pid;
+  pi->ppid = p->parent ? p->parent->pid : 0;
+  pi->state = p->state;
+  pi->cpu = p->cpu;
+  pi->affinity = p->affinity;
+  pi->nice = p->nice;
+  pi->level = p->level;
+  pi->tickets = p->tickets;
+  pi->sz = p->sz;
+  pi->utime = p->utime;
+  pi->stime = p->stime;
+  pi->nvcsw = p->nvcsw;
+  pi->nivcsw = p->nivcsw;
+  pi->rblocks = p->rblocks;
+  pi->wblocks = p->wblocks;
+  pi->pages = p->pages;
+  safestrcpy(pi->name, p->name, sizeof(pi->name));
+  release(&p->lock);
+  release(&wait_lock);
+  return pi->pid;
+}
+
 // Copy to either a user address, or kernel address,
 // depending on usr_dst.
 // Returns 0 on success, -1 on error.
@@ -24,12 +24,25 @@ struct context {
   uint64 s11;
 };
 
+// Priority levels of the multilevel feedback queue, 0 is the highest.
+#define NMLFQ 4
+
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+
+  // RUNNABLE processes waiting for this cpu, one queue per
+  // priority level, oldest first. rqlock protects these, and
+  // is taken after p->lock.
+  struct spinlock rqlock;
+  struct proc *rqhead[NMLFQ];
+  struct proc *rqtail[NMLFQ];
+  int nrunnable;              // Length of the run queues
+  uint rqepoch;               // Priority boost the queues are at
+  int idle;                   // Waiting in wfi for an IPI, see idle()
 };
 
 extern struct cpu cpus[NCPU];
@@ -94,11 +107,50 @@ struct proc {
 
   // p->lock must be held when using these:
   enum procstate state;        // Process state
-  struct proc *parent;         // Parent process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int nice;                    // -20 (favored) to 19 (background)
+  int level;                   // MLFQ level, see setpriority()
+  int levelticks;              // Ticks used at this level
+  uint epoch;                  // Priority boost level was last reset at
+  int tickets;                 // Proportional share, 0 if time-sharing
+  uint64 stride;               // STRIDE1 / tickets
+  uint64 pass;                 // Virtual time, advanced by stride per tick
+  int dlruntime;               // Deadline class: ticks of cpu per period,
+  int dlperiod;                //   0 if not in the class; also under
+  int dldeadline;              //   dl.h.lock. Relative deadline <= dlperiod
+  uint dlabs;                  // Absolute deadline, in ticks
+  int dlbudget;                // Ticks left to run until dlabs
+  int dlthrottled;             // Out of budget, on dl.throttled
+  int isthread;                // Shares its parent's memory, see clone()
+  int cpu;                     // Run queue to join when runnable
+  uint64 affinity;             // Cpus p may run on, one bit each; 0 for all
+  struct proc *rqnext;         // Next in that run queue, under its rqlock
+
+  // the lock of the wait queue of chan protects these:
+  void *wqchan;                // Channel of the wait queue p is in, or 0
+  struct proc *wqnext;         // Neighbours in that wait queue
+  struct proc *wqprev;
+
+  // wait_lock must be held when using these:
+  struct proc *parent;         // Parent process
+  struct proc *children;       // First child, newest first
+  struct proc *sibling;        // Next child of parent
+  struct proc *prevsibling;    // Previous child of parent, or 0
+
+  struct proc *freenext;       // Next unused slot, under freeprocs.lock
+
+  // accounting for getprocinfo(), only updated by the cpu
+  // running the process, so they need no lock:
+  uint64 utime;                // Ticks in user space
+  uint64 stime;                // Ticks in the kernel
+  uint64 nvcsw;                // Voluntary context switches
+  uint64 nivcsw;               // Involuntary context switches
+  uint64 rblocks;              // Disk blocks read
+  uint64 wblocks;              // Disk blocks written
+  uint64 pages;                // Pages allocated
 
   // for mp3
   int thrdstop_ticks;
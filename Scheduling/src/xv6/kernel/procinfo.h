@@ -0,0 +1,20 @@
+// what getprocinfo() reports about a process.
+struct procinfo {
+  int pid;
+  int ppid;          // 0 for init
+  int state;         // enum procstate in proc.h
+  int cpu;           // cpu it last ran on
+  uint64 affinity;   // cpus it may run on, 0 for all, see setaffinity()
+  int nice;
+  int level;         // MLFQ level
+  int tickets;       // proportional share, 0 if time-sharing
+  uint64 sz;         // size of its memory in bytes
+  uint64 utime;      // ticks spent in user space
+  uint64 stime;      // ticks spent in the kernel on its behalf
+  uint64 nvcsw;      // voluntary context switches: sleep()s
+  uint64 nivcsw;     // involuntary ones: preemptions by the timer
+  uint64 rblocks;    // disk blocks read for it
+  uint64 wblocks;    // disk blocks written for it
+  uint64 pages;      // pages kalloc()ed while it was running
+  char name[16];
+};
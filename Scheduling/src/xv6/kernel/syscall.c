@@ -109,6 +109,13 @@ extern uint64 sys_uptime(void);
 extern uint64 sys_thrdstop(void);
 extern uint64 sys_thrdresume(void);
 extern uint64 sys_cancelthrdstop(void);
+extern uint64 sys_thrdsleep(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_settickets(void);
+extern uint64 sys_getprocinfo(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_sched_setattr(void);
 
 
 
@@ -139,6 +146,13 @@ static uint64 (*syscalls[])(void) = {
 [SYS_thrdstop]   sys_thrdstop,
 [SYS_thrdresume]   sys_thrdresume,
 [SYS_cancelthrdstop]   sys_cancelthrdstop,
+[SYS_thrdsleep]   sys_thrdsleep,
+[SYS_clone]   sys_clone,
+[SYS_setpriority]   sys_setpriority,
+[SYS_settickets]   sys_settickets,
+[SYS_getprocinfo]   sys_getprocinfo,
+[SYS_setaffinity]   sys_setaffinity,
+[SYS_sched_setattr]   sys_sched_setattr,
 };
 
 void
@@ -24,3 +24,10 @@
 #define SYS_thrdstop  22
 #define SYS_thrdresume 23
 #define SYS_cancelthrdstop 24
+#define SYS_thrdsleep 25
+#define SYS_clone 26
+#define SYS_setpriority 27
+#define SYS_settickets 28
+#define SYS_getprocinfo 29
+#define SYS_setaffinity 30
+#define SYS_sched_setattr 31
@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "procinfo.h"
 
 uint64
 sys_exit(void)
@@ -29,6 +30,74 @@ sys_fork(void)
   return fork();
 }
 
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack, tp;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 ||
+     argaddr(2, &stack) < 0 || argaddr(3, &tp) < 0)
+    return -1;
+  return clone(fn, arg, stack, tp);
+}
+
+uint64
+sys_setpriority(void)
+{
+  int pid, nice;
+
+  if(argint(0, &pid) < 0 || argint(1, &nice) < 0)
+    return -1;
+  return setpriority(pid, nice);
+}
+
+uint64
+sys_settickets(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return settickets(n);
+}
+
+uint64
+sys_sched_setattr(void)
+{
+  int runtime, period, deadline;
+
+  if(argint(0, &runtime) < 0 || argint(1, &period) < 0 || argint(2, &deadline) < 0)
+    return -1;
+  return sched_setattr(runtime, period, deadline);
+}
+
+uint64
+sys_setaffinity(void)
+{
+  int pid;
+  uint64 mask;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+uint64
+sys_getprocinfo(void)
+{
+  int pid;
+  uint64 addr;
+  struct procinfo pi;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  if(getprocinfo(pid, &pi) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char*)&pi, sizeof(pi)) < 0)
+    return -1;
+  return pi.pid;
+}
+
 uint64
 sys_wait(void)
 {
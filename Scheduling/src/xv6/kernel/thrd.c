@@ -101,3 +101,37 @@ sys_thrdresume(void)
 
   return 0;
 }
+
+// for mp3
+// block until the pending thrdstop timer expires, so an idle
+// thread runtime gives the CPU to other processes instead of
+// spinning. the handler is delivered on the way back to user
+// space, exactly as if the ticks had been consumed while running.
+uint64
+sys_thrdsleep(void)
+{
+  struct proc *proc = myproc();
+  uint ticks0;
+
+  acquire(&tickslock);
+  if (proc->thrdstop_delay <= 0) {
+    release(&tickslock);
+    return -1;
+  }
+  ticks0 = ticks - proc->thrdstop_ticks;
+  while (proc->thrdstop_delay > 0 && ticks - ticks0 < proc->thrdstop_delay) {
+    if (proc->killed) {
+      release(&tickslock);
+      return -1;
+    }
+    sleep(&ticks, &tickslock);
+  }
+  if (proc->thrdstop_delay > 0) {
+    proc->thrdstop_ticks = proc->thrdstop_delay;
+    proc->thrdstop_delay = -1;
+    proc->jump_flag = 1;
+  }
+  release(&tickslock);
+
+  return 0;
+}
@@ -16,6 +16,9 @@ void kernelvec();
 
 extern int devintr();
 
+// in start.c, shared with timervec.
+extern uint64 timer_scratch[NCPU][7];
+
 void
 trapinit(void)
 {
@@ -78,6 +81,7 @@ usertrap(void)
 
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2){
+    p->utime++;
     // for mp3
     if(p->thrdstop_delay > 0){
       p->thrdstop_ticks++;
@@ -187,6 +191,7 @@ kerneltrap()
     // for mp3
     struct proc *p = myproc();
 
+    p->stime++;
     if(p->thrdstop_delay > 0){
       p->thrdstop_ticks++;
       if(p->thrdstop_ticks >= p->thrdstop_delay){
@@ -211,6 +216,7 @@ clockintr()
   ticks++;
   wakeup(&ticks);
   release(&tickslock);
+  dlreplenish();
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -246,17 +252,23 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or an IPI, forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
+    // an IPI only wakes up an idle cpu, it is not a tick.
+    // timervec may set the flag again at any point, so
+    // test and clear it in one instruction.
+    if(__sync_lock_test_and_set(&timer_scratch[cpuid()][5], 0) == 0)
+      return 1;
+
+    if(cpuid() == 0){
+      clockintr();
+    }
+
     return 2;
   } else {
     return 0;
@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+
+# Offline analyzer for the scheduling trace recorded by user/threads.c.
+#
+#   python3 sched-trace.py --fsimg fs.img trace.bin   # file written via thread_trace_file()
+#   python3 sched-trace.py trace.bin                  # binary trace already on the host
+#   python3 sched-trace.py --log xv6.out              # printed trace in a console log
+#
+# Prints a Gantt chart, per-job response times and a deadline-miss report,
+# for each hart of a partitioned run (thread_start_threading_partitioned()):
+# harts keep their own clocks, so their timelines are shown apart.
+
+import argparse
+import re
+import struct
+import sys
+
+# must match user/threads.h
+DISPATCH, FINISH, RT_FINISH, SLEEP, MISS, RELEASE, DROP, APERIODIC = range(1, 9)
+TRACE_MAGIC = 0x54524354
+HEADER = struct.Struct("<iiii")
+EVENT = struct.Struct("<iiiiii")
+# events of traces recorded before they carried a hart
+EVENT_NOHART = struct.Struct("<iiiii")
+
+# must match kernel/fs.h
+BSIZE = 1024
+ROOTINO = 1
+NDIRECT = 12
+SUPERBLOCK = struct.Struct("<8I")
+DINODE = struct.Struct("<hhhhI13I")
+DIRENT = struct.Struct("<H14s")
+
+
+class Event:
+    def __init__(self, type, id, time, allocated_time=0, n=0, hart=0):
+        self.type = type
+        self.id = id
+        self.time = time
+        self.allocated_time = allocated_time
+        self.n = n
+        self.hart = hart
+
+
+def read_fsimg_file(img, name):
+    """Return the content of file `name` in the root directory of an xv6 fs.img."""
+    def block(b):
+        return img[b * BSIZE:(b + 1) * BSIZE]
+
+    sb = SUPERBLOCK.unpack_from(block(1))
+    inodestart = sb[6]
+    ipb = BSIZE // DINODE.size
+
+    def inode(inum):
+        off = (inum % ipb) * DINODE.size
+        return DINODE.unpack_from(block(inodestart + inum // ipb), off)
+
+    def content(inum):
+        di = inode(inum)
+        size, addrs = di[4], list(di[5:5 + NDIRECT])
+        if di[5 + NDIRECT]:
+            addrs += struct.unpack("<%dI" % (BSIZE // 4), block(di[5 + NDIRECT]))
+        data = b"".join(block(a) for a in addrs[:(size + BSIZE - 1) // BSIZE])
+        return data[:size]
+
+    root = content(ROOTINO)
+    for off in range(0, len(root), DIRENT.size):
+        inum, dname = DIRENT.unpack_from(root, off)
+        if inum and dname.rstrip(b"\0").decode() == name:
+            return content(inum)
+    raise SystemExit("%s: not found in file system image" % name)
+
+
+def parse_binary(data):
+    magic, size, count, dropped = HEADER.unpack_from(data)
+    event = {EVENT.size: EVENT, EVENT_NOHART.size: EVENT_NOHART}.get(size)
+    if magic != TRACE_MAGIC or event is None:
+        raise SystemExit("not a thread trace (magic %#x, event size %d)" % (magic, size))
+    if dropped:
+        print("warning: %d oldest events were dropped by the trace ring" % dropped)
+    return [Event(*event.unpack_from(data, HEADER.size + i * size)) for i in range(count)]
+
+
+def parse_log(text):
+    # the printed trace carries no release events, so response times are
+    # unavailable, and no hart, so a partitioned run cannot be told apart
+    patterns = [
+        (DISPATCH, r"dispatch thread#(\d+) at (\d+): allocated_time=(\d+)"),
+        (RT_FINISH, r"thread#(\d+) finish one cycle at (\d+): (\d+) cycles left"),
+        (FINISH, r"thread#(\d+) finish at (\d+)"),
+        (MISS, r"thread#(\d+) misses a deadline at (\d+)"),
+        (DROP, r"thread#(\d+) drops a job at (\d+): (\d+) cycles left"),
+        (APERIODIC, r"aperiodic job (\d+) done at (\d+): response time (\d+)"),
+        (SLEEP, r"run_queue is empty, sleep for (\d+) ticks"),
+    ]
+    events = []
+    now = 0
+    for line in text.splitlines():
+        for type, pat in patterns:
+            m = re.search(pat, line)
+            if not m:
+                continue
+            g = [int(x) for x in m.groups()]
+            if type == DISPATCH:
+                events.append(Event(type, g[0], g[1], g[2]))
+            elif type in (RT_FINISH, DROP):
+                events.append(Event(type, g[0], g[1], 0, g[2]))
+            elif type == APERIODIC:
+                events.append(Event(type, 0, g[1], g[2], g[0]))
+            elif type in (FINISH, MISS):
+                events.append(Event(type, g[0], g[1]))
+            else:
+                events.append(Event(type, 0, now, g[0]))
+            if type != SLEEP:
+                now = events[-1].time
+            break
+    return events
+
+
+def slices(events):
+    """Yield (thread ID, start, end) for every dispatch."""
+    timeline = [e for e in events if e.type not in (RELEASE, APERIODIC)]
+    for i, e in enumerate(timeline):
+        if e.type != DISPATCH:
+            continue
+        end = e.time + e.allocated_time
+        if i + 1 < len(timeline) and timeline[i + 1].type != SLEEP:
+            end = timeline[i + 1].time
+        yield e.id, e.time, end
+
+
+def gantt(events, width):
+    runs = list(slices(events))
+    if not runs:
+        print("no dispatch events")
+        return
+    ids = sorted({e.id for e in events if e.id})
+    horizon = max(max(end for _, _, end in runs), max(e.time for e in events))
+    scale = max(1, (horizon + width - 1) // width)
+    cols = (horizon + scale - 1) // scale + 1
+
+    print("Gantt chart (1 column = %d tick%s, # running, . ready, X missed)" % (scale, "s" if scale > 1 else ""))
+    for id in ids:
+        row = [" "] * cols
+        ready = None
+        for e in events:
+            if e.id != id:
+                continue
+            if e.type == RELEASE:
+                ready = e.time
+            elif e.type in (FINISH, RT_FINISH) and ready is not None:
+                for t in range(ready, e.time):
+                    row[t // scale] = "." if row[t // scale] == " " else row[t // scale]
+                ready = None
+        for tid, start, end in runs:
+            if tid == id:
+                for t in range(start, end):
+                    row[t // scale] = "#"
+        for e in events:
+            if e.id == id and e.type == MISS:
+                row[min(e.time // scale, cols - 1)] = "X"
+        print("thread#%-3d |%s|" % (id, "".join(row)))
+    print("%11s 0%s%d" % ("", " " * (cols - 1 - len(str(horizon))), horizon))
+
+
+def jobs(events):
+    """Yield (thread ID, release, relative deadline, finish or None) for every released job.
+
+    Dropped jobs, like jobs still open at the end of the trace, have no finish time."""
+    open_jobs = {}
+    for e in events:
+        if e.type == RELEASE:
+            open_jobs[e.id] = (e.time, e.allocated_time)
+        elif e.type in (FINISH, RT_FINISH) and e.id in open_jobs:
+            release, deadline = open_jobs.pop(e.id)
+            yield e.id, release, deadline, e.time
+        elif e.type == DROP and e.id in open_jobs:
+            release, deadline = open_jobs.pop(e.id)
+            yield e.id, release, deadline, None
+    for id, (release, deadline) in open_jobs.items():
+        yield id, release, deadline, None
+
+
+def report(events):
+    per_thread = {}
+    for id, release, deadline, finish in jobs(events):
+        per_thread.setdefault(id, []).append((release, deadline, finish))
+
+    if per_thread:
+        print("\nResponse times (finish - release)")
+        print("%-9s %5s %6s %6s %6s %9s" % ("thread", "jobs", "min", "avg", "max", "max late"))
+        for id in sorted(per_thread):
+            done = [(r, d, f) for r, d, f in per_thread[id] if f is not None]
+            if not done:
+                print("thread#%-2d %5d %6s %6s %6s %9s" % (id, 0, "-", "-", "-", "-"))
+                continue
+            resp = [f - r for r, _, f in done]
+            # non-real-time threads have a negative relative deadline (period -1)
+            late = [f - (r + d) for r, d, f in done if d > 0]
+            print("thread#%-2d %5d %6d %6.1f %6d %9s" % (
+                id, len(done), min(resp), sum(resp) / len(resp), max(resp),
+                max(late) if late else "-"))
+    else:
+        print("\nno release events, response times unavailable")
+
+    misses = [e for e in events if e.type == MISS]
+    print("\nDeadline misses: %d" % len(misses))
+    for e in misses:
+        print("  thread#%d missed its deadline at %d" % (e.id, e.time))
+
+    aperiodic = [e.allocated_time for e in events if e.type == APERIODIC]
+    if aperiodic:
+        print("\nAperiodic jobs: %d, response min %d, avg %.1f, max %d" % (
+            len(aperiodic), min(aperiodic), sum(aperiodic) / len(aperiodic), max(aperiodic)))
+
+    drops = [e for e in events if e.type == DROP]
+    if drops:
+        print("\nDropped jobs: %d" % len(drops))
+        for e in drops:
+            print("  thread#%d dropped a job at %d, %d left" % (e.id, e.time, e.n))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Analyze a user-level thread scheduling trace.")
+    ap.add_argument("trace", help="binary trace, or console log with --log")
+    ap.add_argument("--fsimg", help="extract the trace file from this xv6 file system image")
+    ap.add_argument("--log", action="store_true", help="parse the printed trace in a console log")
+    ap.add_argument("--width", type=int, default=100, help="maximum Gantt chart width")
+    args = ap.parse_args()
+
+    if args.log:
+        with open(args.trace) as f:
+            events = parse_log(f.read())
+    elif args.fsimg:
+        with open(args.fsimg, "rb") as f:
+            events = parse_binary(read_fsimg_file(f.read(), args.trace))
+    else:
+        with open(args.trace, "rb") as f:
+            events = parse_binary(f.read())
+
+    harts = sorted({e.hart for e in events})
+    for hart in harts:
+        if len(harts) > 1:
+            print("%s== hart %d ==" % ("\n" if hart != harts[0] else "", hart))
+        timeline = [e for e in events if e.hart == hart]
+        gantt(timeline, args.width)
+        report(timeline)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,603 @@
+// Host-native discrete-event simulator for the user-level thread
+// scheduling policies.
+//
+// schedsim links the unmodified schedule_*() functions from
+// user/threads_sched.c and replays the dispatch loop of user/threads.c
+// on synthetic task sets, so a policy can be benchmarked without
+// building the kernel or booting QEMU. Time advances in whole ticks
+// exactly as threading_system_time does; only the thread bodies are
+// left out.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#undef offsetof // redefined by user/list.h
+
+#include "kernel/types.h"
+#include "user/list.h"
+#include "user/threads.h"
+#include "user/threads_sched.h"
+
+#define TIME_QUANTUM 2
+#define MAXTHREADS 4096
+
+struct policy {
+  char *name;
+  struct threads_sched_result (*fn)(struct threads_sched_args);
+  int real_time;
+  // run queue membership hooks, for policies that index runnable threads
+  void (*enqueue)(struct thread *);
+  void (*dequeue)(struct thread *);
+  // offline table construction before the first release, and its
+  // notification that a thread is gone, for table-driven policies
+  int (*build)(struct threads_sched_args);
+  void (*exit)(struct thread *);
+  // draw harmonic periods, so the table length stays within reach
+  int harmonic;
+};
+
+struct policy policies[] = {
+  { "default", schedule_default, 0 },
+  { "wrr",     schedule_wrr,     0 },
+  { "sjf",     schedule_sjf,     0 },
+  { "lst",     schedule_lst,     1 },
+  { "dm",      schedule_dm,      1 },
+  { "mlfq",    schedule_mlfq,    0 },
+  { "cfs",     schedule_cfs,     0, schedule_cfs_enqueue, schedule_cfs_dequeue },
+  { "cbs",     schedule_cbs,     1 },
+  { "cyclic",  schedule_cyclic,  1, 0, 0, schedule_cyclic_build, schedule_cyclic_exit, 1 },
+};
+
+// options
+struct policy *policy;
+int nthreads = 8;
+double utilization = 0.7;
+double tolerance = 0.01;
+int jobs = 20;
+int trials = 100;
+int quantum = TIME_QUANTUM;
+int keep_going = 0;
+int verbose = 0;
+int real_time = -1;
+int best_effort = 0;
+unsigned long seed = 1;
+char *taskfile = 0;
+long max_ticks = 10000000;
+
+// simulated runtime, mirroring the statics of user/threads.c
+static LIST_HEAD(run_queue);
+static LIST_HEAD(release_queue);
+static struct list_head *current;
+static int now;
+static int allocated_time;
+
+// per-thread bookkeeping, indexed by thread ID
+static int job_release[MAXTHREADS + 1];
+static struct thread *threads[MAXTHREADS + 1];
+
+struct stats {
+  long decisions;
+  long decision_ns;
+  long max_decision_ns;
+  long dispatches;
+  long switches;
+  long preemptions;
+  long finished;
+  long misses;
+  long failed_trials;
+  long rejected;
+  long response_sum;
+  long max_response;
+  long idle_ticks;
+  long bad_idles;
+  long ticks;
+  long redraws;
+  // utilization of the generated task sets after rounding
+  double util_sum;
+  double util_min;
+  double util_max;
+};
+
+static struct stats st;
+
+static unsigned long
+rnd(void)
+{
+  // xorshift64*, so task sets are identical across hosts for one seed
+  seed ^= seed >> 12;
+  seed ^= seed << 25;
+  seed ^= seed >> 27;
+  return seed * 2685821657736338717UL;
+}
+
+static double
+rnd_unit(void)
+{
+  return (rnd() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int
+rnd_range(int lo, int hi)
+{
+  return lo + (int)(rnd() % (unsigned long)(hi - lo + 1));
+}
+
+static long
+nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// same fields as thread_create(), without a stack
+static struct thread*
+sim_thread_create(int id, int is_real_time, int processing_time, int period, int n)
+{
+  struct thread *t = calloc(1, sizeof(struct thread));
+  if(t == 0){
+    perror("calloc");
+    exit(1);
+  }
+  t->ID = id;
+  t->processing_time = processing_time;
+  t->period = period;
+  t->deadline = period;
+  t->n = n;
+  t->is_real_time = is_real_time;
+  t->weight = 1;
+  t->remaining_time = processing_time;
+  threads[id] = t;
+  return t;
+}
+
+static void
+sim_add_at(struct thread *t, int arrival_time)
+{
+  struct release_queue_entry *e = malloc(sizeof(struct release_queue_entry));
+  if(e == 0){
+    perror("malloc");
+    exit(1);
+  }
+  e->thrd = t;
+  e->release_time = arrival_time;
+  if(t->is_real_time)
+    t->current_deadline = arrival_time + t->deadline;
+  list_add_tail(&e->thread_list, &release_queue);
+}
+
+static void
+sim_release(void)
+{
+  struct release_queue_entry *cur, *nxt;
+  list_for_each_entry_safe(cur, nxt, &release_queue, thread_list){
+    if(now >= cur->release_time){
+      cur->thrd->remaining_time = cur->thrd->processing_time;
+      cur->thrd->current_deadline = cur->release_time + cur->thrd->deadline;
+      job_release[cur->thrd->ID] = cur->release_time;
+      cur->thrd->mlfq_level = 0;
+      cur->thrd->mlfq_allocated = 0;
+      list_add_tail(&cur->thrd->thread_list, &run_queue);
+      if(policy->enqueue)
+        policy->enqueue(cur->thrd);
+      list_del(&cur->thread_list);
+      free(cur);
+    }
+  }
+}
+
+// UUniFast: n utilizations summing to u, uniformly distributed
+static void
+uunifast(int n, double u, double *out)
+{
+  double sum = u;
+  for(int i = 0; i < n - 1; i++){
+    double next = sum * pow(rnd_unit(), 1.0 / (n - 1 - i));
+    out[i] = sum - next;
+    sum = next;
+  }
+  out[n - 1] = sum;
+}
+
+// one thread per line, in thread_create() and thread_add_at() order:
+//   is_real_time processing_time period n arrival_time [weight]
+static void
+load_taskset(void)
+{
+  FILE *f = fopen(taskfile, "r");
+  char line[256];
+  int rt, c, period, n, arrival, weight;
+
+  if(f == 0){
+    perror(taskfile);
+    exit(1);
+  }
+  nthreads = 0;
+  while(fgets(line, sizeof(line), f)){
+    if(line[0] == '#')
+      continue;
+    weight = 1;
+    int got = sscanf(line, "%d %d %d %d %d %d", &rt, &c, &period, &n, &arrival, &weight);
+    if(got <= 0)
+      continue;
+    if(got < 5 || nthreads == MAXTHREADS){
+      fprintf(stderr, "%s: bad line: %s", taskfile, line);
+      exit(1);
+    }
+    struct thread *t = sim_thread_create(++nthreads, rt, c, period, n);
+    t->weight = weight;
+    sim_add_at(t, arrival);
+  }
+  fclose(f);
+}
+
+// periods from 10 to 100 ticks, or 10, 20, 40 and 80 for policies
+// that need a short hyperperiod
+static int
+rnd_period(void)
+{
+  if(policy->harmonic)
+    return 10 << rnd_range(0, 3);
+  return rnd_range(10, 100);
+}
+
+// a real-time task set whose utilization after rounding the processing
+// times to whole ticks is within tolerance of the one asked for
+static void
+make_rt_taskset(void)
+{
+  double u[MAXTHREADS];
+  int c[MAXTHREADS], period[MAXTHREADS];
+
+  for(int tries = 0; ; tries++){
+    if(tries == 1000){
+      fprintf(stderr, "schedsim: no task set of %d threads within %.3f of utilization %.2f\n",
+              nthreads, tolerance, utilization);
+      exit(1);
+    }
+    double real = 0;
+    uunifast(nthreads, utilization, u);
+    for(int i = 0; i < nthreads; i++){
+      period[i] = rnd_period();
+      c[i] = (int)(u[i] * period[i] + 0.5);
+      if(c[i] < 1)
+        c[i] = 1;
+      real += (double)c[i] / period[i];
+    }
+    if(fabs(real - utilization) <= tolerance){
+      st.redraws += tries;
+      st.util_sum += real;
+      if(st.util_min == 0 || real < st.util_min)
+        st.util_min = real;
+      if(real > st.util_max)
+        st.util_max = real;
+      break;
+    }
+  }
+  for(int i = 0; i < nthreads; i++){
+    struct thread *t = sim_thread_create(i + 1, 1, c[i], period[i], jobs);
+    sim_add_at(t, 0);
+  }
+}
+
+static void
+make_taskset(void)
+{
+  if(taskfile){
+    load_taskset();
+  } else if(real_time){
+    make_rt_taskset();
+    // best-effort threads mixed into the real-time set
+    for(int i = 0; i < best_effort; i++){
+      struct thread *t = sim_thread_create(nthreads + i + 1, 0, rnd_range(10, 200), -1, 1);
+      sim_add_at(t, rnd_range(0, 100));
+    }
+  } else {
+    for(int i = 0; i < nthreads; i++){
+      struct thread *t = sim_thread_create(i + 1, 0, rnd_range(1, 20), -1, 1);
+      t->weight = rnd_range(1, 4);
+      sim_add_at(t, rnd_range(0, 10 * nthreads));
+    }
+  }
+}
+
+static void
+clear_taskset(void)
+{
+  struct release_queue_entry *e, *ne;
+  struct thread *t, *nt;
+
+  list_for_each_entry_safe(e, ne, &release_queue, thread_list){
+    list_del(&e->thread_list);
+    free(e);
+  }
+  list_for_each_entry_safe(t, nt, &run_queue, thread_list){
+    if(policy->dequeue)
+      policy->dequeue(t);
+    list_del(&t->thread_list);
+  }
+  for(int i = 1; i <= MAXTHREADS; i++){
+    if(threads[i] && policy->exit)
+      policy->exit(threads[i]);
+    free(threads[i]);
+    threads[i] = 0;
+  }
+}
+
+// __schedule(), timed
+static void
+sim_schedule(void)
+{
+  struct threads_sched_args args = {
+    .time_quantum = quantum,
+    .current_time = now,
+    .run_queue = &run_queue,
+    .release_queue = &release_queue,
+  };
+
+  long t0 = nsec();
+  struct threads_sched_result r = policy->fn(args);
+  long dt = nsec() - t0;
+
+  st.decisions++;
+  st.decision_ns += dt;
+  if(dt > st.max_decision_ns)
+    st.max_decision_ns = dt;
+
+  struct list_head *pos;
+  int found = r.scheduled_thread_list_member == &run_queue;
+  list_for_each(pos, &run_queue)
+    if(pos == r.scheduled_thread_list_member)
+      found = 1;
+  if(!found){
+    fprintf(stderr, "schedsim: %s returned a thread that is not in the run queue at %d\n",
+            policy->name, now);
+    exit(1);
+  }
+
+  current = r.scheduled_thread_list_member;
+  allocated_time = r.allocated_time;
+}
+
+// end of the current job: __finish_current() / __rt_finish_current()
+static void
+sim_finish(struct thread *t, int missed)
+{
+  int resp = now - job_release[t->ID];
+
+  --t->n;
+  if(missed){
+    st.misses++;
+  } else {
+    st.finished++;
+    st.response_sum += resp;
+    if(resp > st.max_response)
+      st.max_response = resp;
+  }
+  if(verbose && !missed){
+    if(t->is_real_time)
+      printf("thread#%d finish one cycle at %d: %d cycles left\n", t->ID, now, t->n);
+    else
+      printf("thread#%d finish at %d\n", t->ID, now);
+  }
+
+  if(policy->dequeue)
+    policy->dequeue(t);
+  list_del(&t->thread_list);
+  if(t->n > 0)
+    sim_add_at(t, t->current_deadline);
+  else if(policy->exit)
+    policy->exit(t);
+}
+
+// run one trial; returns -1 if it stopped on a deadline miss
+static int
+sim_run(void)
+{
+  struct thread *last = 0;
+  long stalls = 0;
+
+  now = 0;
+  current = &run_queue;
+  if(policy->build){
+    struct threads_sched_args args = {
+      .time_quantum = quantum,
+      .current_time = now,
+      .run_queue = &run_queue,
+      .release_queue = &release_queue,
+    };
+    if(policy->build(args) < 0){
+      if(verbose)
+        printf("%s rejects the task set\n", policy->name);
+      st.rejected++;
+      return -1;
+    }
+  }
+  while(!list_empty(&run_queue) || !list_empty(&release_queue)){
+    sim_release();
+    sim_schedule();
+
+    if(current == &run_queue){
+      if(list_empty(&run_queue) && list_empty(&release_queue))
+        break;
+      if(allocated_time <= 0){
+        // threads.c would sleep forever here; skip to the next release instead
+        struct release_queue_entry *e;
+        int next = -1;
+        list_for_each_entry(e, &release_queue, thread_list)
+          if(next < 0 || e->release_time < next)
+            next = e->release_time;
+        if(next <= now){
+          fprintf(stderr, "schedsim: %s idles with runnable threads at %d\n", policy->name, now);
+          exit(1);
+        }
+        st.bad_idles++;
+        allocated_time = next - now;
+      }
+      if(verbose)
+        printf("run_queue is empty, sleep for %d ticks\n", allocated_time);
+      now += allocated_time;
+      st.idle_ticks += allocated_time;
+      continue;
+    }
+
+    // __dispatch()
+    struct thread *t = list_entry(current, struct thread, thread_list);
+    if(!t->is_real_time && allocated_time < 0){
+      fprintf(stderr, "schedsim: %s allocated %d ticks at %d\n", policy->name, allocated_time, now);
+      exit(1);
+    }
+    // a negative allocation means the deadline can no longer be met
+    if(t->is_real_time && allocated_time <= 0){
+      if(verbose)
+        printf("thread#%d misses a deadline at %d\n", t->ID, t->current_deadline);
+      if(!keep_going){
+        st.misses++;
+        return -1;
+      }
+      sim_finish(t, 1);
+      continue;
+    }
+    if(allocated_time == 0 && ++stalls > 1000000){
+      fprintf(stderr, "schedsim: %s makes no progress at %d\n", policy->name, now);
+      exit(1);
+    }
+    if(allocated_time > 0)
+      stalls = 0;
+
+    if(verbose)
+      printf("dispatch thread#%d at %d: allocated_time=%d\n", t->ID, now, allocated_time);
+    st.dispatches++;
+    if(t != last)
+      st.switches++;
+    last = t;
+
+    // switch_handler()
+    now += allocated_time;
+    sim_release();
+    t->remaining_time -= allocated_time;
+
+    if(t->is_real_time &&
+       (now > t->current_deadline || (now == t->current_deadline && t->remaining_time > 0))){
+      if(verbose)
+        printf("thread#%d misses a deadline at %d\n", t->ID, now);
+      if(!keep_going){
+        st.misses++;
+        return -1;
+      }
+      sim_finish(t, 1);
+    } else if(t->remaining_time <= 0){
+      sim_finish(t, 0);
+    } else {
+      st.preemptions++;
+      list_move_tail(&t->thread_list, &run_queue);
+    }
+
+    if(now > max_ticks){
+      fprintf(stderr, "schedsim: trial exceeded %ld ticks\n", max_ticks);
+      exit(1);
+    }
+  }
+  return 0;
+}
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+    "usage: schedsim [-p policy] [-n threads] [-u utilization] [-j jobs] [-t trials]\n"
+    "                [-q quantum] [-s seed] [-e tolerance] [-r|-R] [-b n] [-k] [-v]\n"
+    "                [-f taskset]\n"
+    "  -p  default, wrr, sjf, lst, dm, mlfq, cfs, cbs or cyclic\n"
+    "  -u  total utilization of real-time task sets\n"
+    "  -e  redraw task sets whose utilization after rounding is further off (0.01)\n"
+    "  -j  releases per real-time thread\n"
+    "  -r  real-time task set, -R non-real-time task set (default: by policy)\n"
+    "  -b  add n best-effort threads to a real-time task set\n"
+    "  -k  drop the job and keep going on a deadline miss instead of stopping\n"
+    "  -v  print the dispatch trace in the format of user/threads.c\n"
+    "  -f  replay the task set in this file, one thread per line:\n"
+    "      is_real_time processing_time period n arrival_time [weight]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int c;
+
+  policy = &policies[0];
+  while((c = getopt(argc, argv, "p:n:u:j:t:q:s:e:f:b:rRkv")) != -1){
+    switch(c){
+    case 'p':
+      policy = 0;
+      for(int i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+        if(strcmp(optarg, policies[i].name) == 0)
+          policy = &policies[i];
+      if(policy == 0)
+        usage();
+      break;
+    case 'n': nthreads = atoi(optarg); break;
+    case 'u': utilization = atof(optarg); break;
+    case 'j': jobs = atoi(optarg); break;
+    case 't': trials = atoi(optarg); break;
+    case 'q': quantum = atoi(optarg); break;
+    case 's': seed = strtoul(optarg, 0, 0); break;
+    case 'e': tolerance = atof(optarg); break;
+    case 'r': real_time = 1; break;
+    case 'R': real_time = 0; break;
+    case 'b': best_effort = atoi(optarg); break;
+    case 'k': keep_going = 1; break;
+    case 'v': verbose = 1; break;
+    case 'f': taskfile = optarg; trials = 1; break;
+    default: usage();
+    }
+  }
+  if(nthreads < 1 || nthreads + best_effort > MAXTHREADS || best_effort < 0 || jobs < 1 || trials < 1 || seed == 0 || tolerance < 0)
+    usage();
+  if(real_time < 0)
+    real_time = policy->real_time;
+
+  long t0 = nsec();
+  for(int i = 0; i < trials; i++){
+    make_taskset();
+    if(sim_run() < 0)
+      st.failed_trials++;
+    st.ticks += now;
+    clear_taskset();
+  }
+  long wall = nsec() - t0;
+
+  printf("policy %s, %d %s threads, %d trials", policy->name, nthreads,
+         real_time ? "real-time" : "non-real-time", trials);
+  if(real_time && !taskfile)
+    printf(", utilization %.2f, %d jobs each", utilization, jobs);
+  if(real_time && !taskfile && best_effort)
+    printf(", %d best-effort threads", best_effort);
+  printf("\n");
+  if(real_time && !taskfile)
+    printf("utilization     %.3f realised avg (min %.3f, max %.3f), %ld sets redrawn\n",
+           st.util_sum / trials, st.util_min, st.util_max, st.redraws);
+  printf("decisions       %ld (%.2f M/s wall)\n", st.decisions,
+         wall > 0 ? st.decisions * 1000.0 / wall : 0.0);
+  printf("decision ns     avg %.1f, max %ld\n",
+         st.decisions ? (double)st.decision_ns / st.decisions : 0.0, st.max_decision_ns);
+  printf("dispatches      %ld, context switches %ld, preemptions %ld\n",
+         st.dispatches, st.switches, st.preemptions);
+  printf("jobs finished   %ld, response avg %.1f, max %ld ticks\n", st.finished,
+         st.finished ? (double)st.response_sum / st.finished : 0.0, st.max_response);
+  printf("deadline misses %ld", st.misses);
+  if(!keep_going)
+    printf(" (%ld of %d trials stopped)", st.failed_trials, trials);
+  printf("\n");
+  if(st.rejected)
+    printf("rejected        %ld task sets, not schedulable by %s\n", st.rejected, policy->name);
+  printf("idle ticks      %ld of %ld\n", st.idle_ticks, st.ticks);
+  if(st.bad_idles)
+    printf("warning: %ld idle decisions without a positive sleep time\n", st.bad_idles);
+  return 0;
+}
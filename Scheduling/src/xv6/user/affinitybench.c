@@ -0,0 +1,102 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/procinfo.h"
+#include "user/user.h"
+
+// compare cpu-bound throughput with and without hard affinity:
+// workers sweep a private working set, once free to move between
+// cpus and once each pinned to cpu (i % ncpus).
+//
+//   affinitybench [workers [ticks [ncpus]]]   default: 8 100 4
+//
+// boot with `make qemu CPUS=4` (or pass the matching ncpus).
+
+#define MAXWORKERS 16
+#define WSET (64 * 1024)   // working set of each worker, in bytes
+
+static char wset[WSET];
+
+struct result {
+  uint64 loops;
+  int moves;         // cpu changes seen by sampling getprocinfo()
+};
+
+static void
+work(int duration, int fd)
+{
+  struct result r = {0, 0};
+  int start, i, lastcpu = -1;
+  struct procinfo pi;
+
+  start = uptime();
+  while(uptime() - start < duration){
+    // one sweep dirties every cache line and touches every page.
+    for(i = 0; i < WSET; i += 64)
+      wset[i]++;
+    r.loops++;
+    if((r.loops & 255) == 0 && getprocinfo(getpid(), &pi) == getpid()){
+      if(lastcpu >= 0 && pi.cpu != lastcpu)
+        r.moves++;
+      lastcpu = pi.cpu;
+    }
+  }
+  // one write, so results of different workers do not mix.
+  write(fd, &r, sizeof(r));
+}
+
+static void
+run(int workers, int duration, int ncpus, int pin)
+{
+  int fds[2], i, moves = 0;
+  uint64 total = 0;
+  struct result r;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "affinitybench: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < workers; i++){
+    if(fork() == 0){
+      close(fds[0]);
+      if(pin && setaffinity(0, 1L << (i % ncpus)) < 0){
+        fprintf(2, "affinitybench: cpu %d is not running\n", i % ncpus);
+        exit(1);
+      }
+      work(duration, fds[1]);
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  for(i = 0; i < workers; i++){
+    if(read(fds[0], &r, sizeof(r)) != sizeof(r))
+      break;
+    total += r.loops;
+    moves += r.moves;
+  }
+  close(fds[0]);
+  for(i = 0; i < workers; i++)
+    wait(0);
+  printf("%s: %d sweeps in %d ticks, %d per tick, %d migrations seen\n",
+         pin ? "pinned  " : "unpinned", (int)total, duration,
+         (int)(total / duration), moves);
+}
+
+int
+main(int argc, char **argv)
+{
+  int workers = 8, duration = 100, ncpus = 4;
+
+  if(argc > 1)
+    workers = atoi(argv[1]);
+  if(argc > 2)
+    duration = atoi(argv[2]);
+  if(argc > 3)
+    ncpus = atoi(argv[3]);
+  if(workers < 1 || workers > MAXWORKERS || duration < 1 || ncpus < 1 || ncpus > 64){
+    fprintf(2, "usage: affinitybench [workers(1-%d) [ticks [ncpus]]]\n", MAXWORKERS);
+    exit(1);
+  }
+  run(workers, duration, ncpus, 0);
+  run(workers, duration, ncpus, 1);
+  exit(0);
+}
@@ -0,0 +1,67 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// parallel page allocation: each worker grows its memory by
+// a chunk with sbrk() and gives it back, over and over, so the
+// kernel allocates and frees a page for every 4096 bytes.
+//
+//   allocbench [workers [ticks [kbytes]]]   default: 8 100 256
+//
+// boot with `make qemu CPUS=8` and compare kernels; rounds per
+// tick stop scaling when the harts queue on one allocator lock.
+
+#define MAXWORKERS 16
+
+int
+main(int argc, char **argv)
+{
+  int workers = 8, duration = 100, kbytes = 256, fds[2], i, start;
+  uint64 rounds, total = 0;
+
+  if(argc > 1)
+    workers = atoi(argv[1]);
+  if(argc > 2)
+    duration = atoi(argv[2]);
+  if(argc > 3)
+    kbytes = atoi(argv[3]);
+  if(workers < 1 || workers > MAXWORKERS || duration < 1 || kbytes < 4){
+    fprintf(2, "usage: allocbench [workers(1-%d) [ticks [kbytes]]]\n", MAXWORKERS);
+    exit(1);
+  }
+
+  if(pipe(fds) < 0){
+    fprintf(2, "allocbench: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < workers; i++){
+    if(fork() == 0){
+      close(fds[0]);
+      rounds = 0;
+      start = uptime();
+      while(uptime() - start < duration){
+        if(sbrk(kbytes * 1024) == (char*)-1){
+          fprintf(2, "allocbench: out of memory\n");
+          break;
+        }
+        sbrk(-kbytes * 1024);
+        rounds++;
+      }
+      write(fds[1], &rounds, sizeof(rounds));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  for(i = 0; i < workers; i++){
+    if(read(fds[0], &rounds, sizeof(rounds)) != sizeof(rounds))
+      break;
+    total += rounds;
+  }
+  close(fds[0]);
+  for(i = 0; i < workers; i++)
+    wait(0);
+  printf("%d workers: %d rounds of %d KB in %d ticks, %d pages per tick\n",
+         workers, (int)total, kbytes, duration,
+         (int)(total * (kbytes / 4) / duration));
+  exit(0);
+}
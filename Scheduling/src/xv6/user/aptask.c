@@ -0,0 +1,61 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/threads.h"
+
+// Periodic, sporadic and aperiodic work under one real-time policy:
+// a periodic "device" thread raises an event every period, which
+// releases a sporadic handler thread and queues an aperiodic request
+// for the polling server, next to a CPU-bound control loop.
+
+#define NULL 0
+
+struct thread *handler;
+int handled = 0, served = 0;
+
+void control(void *arg)
+{
+    while (1) {
+    }
+}
+
+// one tick of work for an aperiodic request
+void request(void *arg)
+{
+    int start = uptime();
+    while (uptime() == start) {
+    }
+    ++served;
+}
+
+void device(void *arg)
+{
+    while (1) {
+        thread_release_now(handler);
+        thread_submit(request, NULL);
+        thread_finish_job();
+    }
+}
+
+void interrupt_handler(void *arg)
+{
+    while (1) {
+        ++handled;
+        thread_finish_job();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    thread_add_at(thread_create(control, NULL, 1, 4, 10, 6), 0);
+    thread_add_at(thread_create(device, NULL, 1, 1, 6, 10), 0);
+
+    handler = thread_create(interrupt_handler, NULL, 1, 1, 5, 10);
+    thread_set_sporadic(handler);
+
+    thread_add_at(thread_create_polling_server(2, 8, 10), 0);
+
+    thread_start_threading();
+    printf("\nhandled %d events, served %d requests\n", handled, served);
+    thread_sched_report();
+    exit(0);
+}
@@ -0,0 +1,138 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/procinfo.h"
+#include "user/user.h"
+
+// run periodic processes in the deadline class next to cpu hogs
+// and count the jobs that finish after their deadline.
+//
+//   dltest [hogs [dl]]     default: 4 1
+//
+// with dl 0 the periodic processes stay time-sharing, to compare.
+// boot with CPUS=1, or run more hogs than there are cpus.
+
+#define JOBS 10
+
+struct task {
+  int runtime;       // ticks of cpu each job needs
+  int period;        // = relative deadline
+} tasks[] = {
+  {2, 10},
+  {3, 15},
+  {5, 20},
+};
+#define NTASK (sizeof(tasks) / sizeof(tasks[0]))
+
+struct result {
+  int task;
+  int misses;
+  int maxlate;
+};
+
+// cpu ticks used so far.
+static int
+cputime(void)
+{
+  struct procinfo pi;
+
+  if(getprocinfo(getpid(), &pi) != getpid())
+    return 0;
+  return pi.utime + pi.stime;
+}
+
+static void
+periodic(struct task *t, int usedl, int fd)
+{
+  struct result r = {t - tasks, 0, 0};
+  int release, start, k, late;
+
+  // a tick of slack: runtime is charged in whole ticks.
+  if(usedl && sched_setattr(t->runtime + 1, t->period, 0) < 0){
+    fprintf(2, "dltest: sched_setattr(%d, %d) refused\n", t->runtime + 1, t->period);
+    exit(1);
+  }
+  release = uptime();
+  for(k = 0; k < JOBS; k++){
+    start = cputime();
+    while(cputime() - start < t->runtime)
+      ;
+    late = uptime() - (release + t->period);
+    if(late > 0){
+      r.misses++;
+      if(late > r.maxlate)
+        r.maxlate = late;
+    }
+    release += t->period;
+    if(release > uptime())
+      sleep(release - uptime());
+  }
+  write(fd, &r, sizeof(r));
+}
+
+int
+main(int argc, char **argv)
+{
+  int hogs = 4, usedl = 1, fds[2], hog[16], i;
+  struct result r;
+
+  if(argc > 1)
+    hogs = atoi(argv[1]);
+  if(argc > 2)
+    usedl = atoi(argv[2]);
+  if(hogs < 0 || hogs > 16){
+    fprintf(2, "usage: dltest [hogs(0-16) [dl]]\n");
+    exit(1);
+  }
+
+  for(i = 0; i < hogs; i++){
+    if((hog[i] = fork()) == 0){
+      for(;;)
+        ;
+    }
+  }
+
+  if(pipe(fds) < 0){
+    fprintf(2, "dltest: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < NTASK; i++){
+    if(fork() == 0){
+      close(fds[0]);
+      periodic(&tasks[i], usedl, fds[1]);
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  if(usedl){
+    // the tasks reserve densities of about 87% of a cpu by now.
+    sleep(2);
+    if(sched_setattr(6, 10, 0) == 0){
+      printf("dltest: admission control let a 60%% reservation in\n");
+      sched_setattr(0, 0, 0);
+    } else
+      printf("admission control refused a 60%% reservation, as it should on 1 cpu\n");
+    // 5% of a cpu, but all of it within each deadline: global
+    // EDF cannot promise that next to the tasks on any number
+    // of cpus, though the utilizations add up to less than one.
+    if(sched_setattr(1, 20, 1) == 0){
+      printf("dltest: admission control let a 1/20 reservation with deadline 1 in\n");
+      sched_setattr(0, 0, 0);
+    } else
+      printf("admission control refused a 1/20 reservation with deadline 1, as it should\n");
+  }
+
+  printf("%d hogs, %s class\n", hogs, usedl ? "deadline" : "time-sharing");
+  for(i = 0; i < NTASK; i++){
+    if(read(fds[0], &r, sizeof(r)) != sizeof(r))
+      break;
+    printf("task %d (%d/%d): %d of %d jobs missed, max late %d\n", r.task,
+           tasks[r.task].runtime, tasks[r.task].period, r.misses, JOBS, r.maxlate);
+  }
+  close(fds[0]);
+  for(i = 0; i < hogs; i++)
+    kill(hog[i]);
+  for(i = 0; i < hogs + NTASK; i++)
+    wait(0);
+  exit(0);
+}
@@ -0,0 +1,80 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// measure what idle cpus cost the busy ones: a cpu-bound loop
+// runs alone while every other cpu has nothing to do, then two
+// processes bounce a byte through a pipe, which needs sleeping
+// cpus to wake up quickly.
+//
+//   idlebench [ticks]
+//
+// boot with e.g. `make qemu CPUS=8` and compare kernels; under
+// qemu, harts polling for work take host time from the busy one.
+
+static void
+cpubound(int duration)
+{
+  uint64 loops = 0;
+  volatile int x = 0;
+  int start, i;
+
+  start = uptime();
+  while(uptime() - start < duration){
+    for(i = 0; i < 10000; i++)
+      x++;
+    loops++;
+  }
+  printf("cpu-bound: %d loops in %d ticks, %d per tick\n",
+         (int)loops, duration, (int)(loops / duration));
+}
+
+static void
+pingpong(int duration)
+{
+  int ping[2], pong[2], start, n = 0;
+  char c = 0;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    fprintf(2, "idlebench: pipe failed\n");
+    exit(1);
+  }
+  if(fork() == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+  start = uptime();
+  while(uptime() - start < duration){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      fprintf(2, "idlebench: ping-pong failed\n");
+      exit(1);
+    }
+    n++;
+  }
+  close(ping[1]);
+  close(pong[0]);
+  wait(0);
+  printf("ping-pong: %d round trips in %d ticks, %d per tick\n",
+         n, duration, n / duration);
+}
+
+int
+main(int argc, char **argv)
+{
+  int duration = 50;
+
+  if(argc > 1)
+    duration = atoi(argv[1]);
+  if(duration < 1){
+    fprintf(2, "usage: idlebench [ticks]\n");
+    exit(1);
+  }
+  cpubound(duration);
+  pingpong(duration);
+  exit(0);
+}
@@ -0,0 +1,28 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// run a command with a nice value, e.g. `nice 19 stressfs &`
+// to keep a batch job from slowing down the shell
+int
+main(int argc, char **argv)
+{
+  int nice;
+
+  if(argc < 3){
+    fprintf(2, "usage: nice value command [arg...]\n");
+    exit(1);
+  }
+  // atoi() takes no sign
+  if(argv[1][0] == '-')
+    nice = -atoi(argv[1] + 1);
+  else
+    nice = atoi(argv[1]);
+  if(setpriority(0, nice) < 0){
+    fprintf(2, "nice: setpriority failed\n");
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "nice: exec %s failed\n", argv[2]);
+  exit(1);
+}
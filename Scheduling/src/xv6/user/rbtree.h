@@ -0,0 +1,302 @@
+/**
+ * Intrusive red-black tree for user space programs, in the style of
+ * user/list.h and the linux kernel's rbtree: a `struct rb_node` is
+ * embedded in the containing structure, the caller walks down the tree
+ * to find the insertion point and links the node, then calls
+ * rb_insert_color() to rebalance.
+ *
+ *     struct rb_node **link = &root->rb_node, *parent = NULL;
+ *     while (*link) {
+ *         parent = *link;
+ *         if (key < rb_entry(parent, struct foo, node)->key)
+ *             link = &parent->rb_left;
+ *         else
+ *             link = &parent->rb_right;
+ *     }
+ *     rb_link_node(&new->node, parent, link);
+ *     rb_insert_color(&new->node, root);
+ */
+#ifndef _RBTREE_H
+#define _RBTREE_H
+
+#include "user/list.h"
+
+#define RB_RED   0
+#define RB_BLACK 1
+
+struct rb_node
+{
+    struct rb_node *rb_parent;
+    struct rb_node *rb_left;
+    struct rb_node *rb_right;
+    int rb_color;
+};
+
+struct rb_root
+{
+    struct rb_node *rb_node;
+};
+
+#define RB_ROOT (struct rb_root) { NULL, }
+
+/**
+ * rb_entry - get the struct for this node
+ * @ptr:    the &struct rb_node pointer.
+ * @type:   the type of the struct this is embedded in.
+ * @member: the name of the rb_node within the struct.
+ */
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define RB_EMPTY_ROOT(root) ((root)->rb_node == NULL)
+
+static inline int __rb_is_black(struct rb_node *node)
+{
+    return node == NULL || node->rb_color == RB_BLACK;
+}
+
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent,
+                                struct rb_node **rb_link)
+{
+    node->rb_parent = parent;
+    node->rb_left = node->rb_right = NULL;
+    node->rb_color = RB_RED;
+    *rb_link = node;
+}
+
+/* replace @old by @new as the child of @parent (or as the root) */
+static inline void __rb_change_child(struct rb_node *old, struct rb_node *new_node,
+                                     struct rb_node *parent, struct rb_root *root)
+{
+    if (parent == NULL)
+        root->rb_node = new_node;
+    else if (parent->rb_left == old)
+        parent->rb_left = new_node;
+    else
+        parent->rb_right = new_node;
+}
+
+static inline void __rb_rotate_left(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *right = node->rb_right;
+    struct rb_node *parent = node->rb_parent;
+
+    node->rb_right = right->rb_left;
+    if (right->rb_left)
+        right->rb_left->rb_parent = node;
+    right->rb_left = node;
+    right->rb_parent = parent;
+    __rb_change_child(node, right, parent, root);
+    node->rb_parent = right;
+}
+
+static inline void __rb_rotate_right(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *left = node->rb_left;
+    struct rb_node *parent = node->rb_parent;
+
+    node->rb_left = left->rb_right;
+    if (left->rb_right)
+        left->rb_right->rb_parent = node;
+    left->rb_right = node;
+    left->rb_parent = parent;
+    __rb_change_child(node, left, parent, root);
+    node->rb_parent = left;
+}
+
+/**
+ * rb_insert_color - rebalance after rb_link_node()
+ * @node: the node just linked.
+ * @root: the tree.
+ */
+static inline void rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *parent, *gparent, *uncle;
+
+    while ((parent = node->rb_parent) && parent->rb_color == RB_RED) {
+        gparent = parent->rb_parent;
+        if (parent == gparent->rb_left) {
+            uncle = gparent->rb_right;
+            if (!__rb_is_black(uncle)) {
+                uncle->rb_color = RB_BLACK;
+                parent->rb_color = RB_BLACK;
+                gparent->rb_color = RB_RED;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->rb_right) {
+                __rb_rotate_left(parent, root);
+                node = parent;
+                parent = node->rb_parent;
+            }
+            parent->rb_color = RB_BLACK;
+            gparent->rb_color = RB_RED;
+            __rb_rotate_right(gparent, root);
+        } else {
+            uncle = gparent->rb_left;
+            if (!__rb_is_black(uncle)) {
+                uncle->rb_color = RB_BLACK;
+                parent->rb_color = RB_BLACK;
+                gparent->rb_color = RB_RED;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->rb_left) {
+                __rb_rotate_right(parent, root);
+                node = parent;
+                parent = node->rb_parent;
+            }
+            parent->rb_color = RB_BLACK;
+            gparent->rb_color = RB_RED;
+            __rb_rotate_left(gparent, root);
+        }
+    }
+    root->rb_node->rb_color = RB_BLACK;
+}
+
+/* restore the black height after removing a black node above @node */
+static inline void __rb_erase_color(struct rb_node *node, struct rb_node *parent,
+                                    struct rb_root *root)
+{
+    struct rb_node *sibling;
+
+    while (node != root->rb_node && __rb_is_black(node)) {
+        if (node == parent->rb_left) {
+            sibling = parent->rb_right;
+            if (!__rb_is_black(sibling)) {
+                sibling->rb_color = RB_BLACK;
+                parent->rb_color = RB_RED;
+                __rb_rotate_left(parent, root);
+                sibling = parent->rb_right;
+            }
+            if (__rb_is_black(sibling->rb_left) && __rb_is_black(sibling->rb_right)) {
+                sibling->rb_color = RB_RED;
+                node = parent;
+                parent = node->rb_parent;
+                continue;
+            }
+            if (__rb_is_black(sibling->rb_right)) {
+                sibling->rb_left->rb_color = RB_BLACK;
+                sibling->rb_color = RB_RED;
+                __rb_rotate_right(sibling, root);
+                sibling = parent->rb_right;
+            }
+            sibling->rb_color = parent->rb_color;
+            parent->rb_color = RB_BLACK;
+            sibling->rb_right->rb_color = RB_BLACK;
+            __rb_rotate_left(parent, root);
+        } else {
+            sibling = parent->rb_left;
+            if (!__rb_is_black(sibling)) {
+                sibling->rb_color = RB_BLACK;
+                parent->rb_color = RB_RED;
+                __rb_rotate_right(parent, root);
+                sibling = parent->rb_left;
+            }
+            if (__rb_is_black(sibling->rb_left) && __rb_is_black(sibling->rb_right)) {
+                sibling->rb_color = RB_RED;
+                node = parent;
+                parent = node->rb_parent;
+                continue;
+            }
+            if (__rb_is_black(sibling->rb_left)) {
+                sibling->rb_right->rb_color = RB_BLACK;
+                sibling->rb_color = RB_RED;
+                __rb_rotate_left(sibling, root);
+                sibling = parent->rb_left;
+            }
+            sibling->rb_color = parent->rb_color;
+            parent->rb_color = RB_BLACK;
+            sibling->rb_left->rb_color = RB_BLACK;
+            __rb_rotate_right(parent, root);
+        }
+        node = root->rb_node;
+        break;
+    }
+    if (node)
+        node->rb_color = RB_BLACK;
+}
+
+/**
+ * rb_erase - remove a node from the tree and rebalance
+ * @node: the node to remove, it must be in @root.
+ * @root: the tree.
+ */
+static inline void rb_erase(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *child, *parent;
+    int color;
+
+    if (node->rb_left && node->rb_right) {
+        // replace node by its successor, the leftmost node of its right subtree
+        struct rb_node *succ = node->rb_right;
+        while (succ->rb_left)
+            succ = succ->rb_left;
+
+        child = succ->rb_right;
+        parent = succ->rb_parent;
+        color = succ->rb_color;
+
+        if (parent == node) {
+            parent = succ;
+        } else {
+            if (child)
+                child->rb_parent = parent;
+            parent->rb_left = child;
+            succ->rb_right = node->rb_right;
+            node->rb_right->rb_parent = succ;
+        }
+
+        succ->rb_parent = node->rb_parent;
+        succ->rb_color = node->rb_color;
+        succ->rb_left = node->rb_left;
+        node->rb_left->rb_parent = succ;
+        __rb_change_child(node, succ, node->rb_parent, root);
+    } else {
+        child = node->rb_left ? node->rb_left : node->rb_right;
+        parent = node->rb_parent;
+        color = node->rb_color;
+
+        if (child)
+            child->rb_parent = parent;
+        __rb_change_child(node, child, parent, root);
+    }
+
+    if (color == RB_BLACK)
+        __rb_erase_color(child, parent, root);
+}
+
+/**
+ * rb_first - the leftmost (smallest) node, or NULL if the tree is empty
+ * @root: the tree.
+ */
+static inline struct rb_node *rb_first(const struct rb_root *root)
+{
+    struct rb_node *n = root->rb_node;
+
+    if (n == NULL)
+        return NULL;
+    while (n->rb_left)
+        n = n->rb_left;
+    return n;
+}
+
+/**
+ * rb_next - the in-order successor of @node, or NULL
+ * @node: a node in the tree.
+ */
+static inline struct rb_node *rb_next(const struct rb_node *node)
+{
+    struct rb_node *parent;
+
+    if (node->rb_right) {
+        node = node->rb_right;
+        while (node->rb_left)
+            node = node->rb_left;
+        return (struct rb_node *)node;
+    }
+    while ((parent = node->rb_parent) && node == parent->rb_right)
+        node = parent;
+    return parent;
+}
+
+#endif
@@ -0,0 +1,209 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/threads.h"
+
+// Stress benchmark for the real-time policies: generates random periodic
+// task sets with a target total utilization and reports, for each
+// utilization, how many task sets miss a deadline under the policy this
+// program was built with (SCHEDPOLICY).
+//
+//   rtbench [nthreads [trials [seed [harts]]]]
+//
+// With harts > 1 the task sets run partitioned on that many harts (boot
+// with `make qemu CPUS=n`), and the utilization goes up to harts * 100%;
+// a set the partitioning rejects counts as missed. A set is redrawn
+// until its utilization after rounding is within 2% per hart of the
+// target, so each row measures the utilization it is labelled with.
+//
+// Each task set runs in a forked child, since a deadline miss ends the
+// process. xv6 user programs cannot use floating point, so utilization
+// is kept in per-mille.
+
+#define NULL 0
+
+#define MAXTHREADS 15 // MAX_THRD_NUM contexts, one of them for the main thread
+// periods long enough that rounding processing times to whole ticks
+// seldom moves a set far from its utilization
+#define PERIOD_MIN 10
+#define PERIOD_MAX 100
+// the first job of a synchronous release is the one most likely to
+// miss, so a second one is enough to see the pattern repeat
+#define JOBS 2
+// per-mille of a hart the utilization after rounding may be off by
+#define TOLERANCE 20
+#define TRIES 1000
+
+#ifdef THREAD_SCHEDULER_LST
+#define POLICY "LST"
+#elif defined(THREAD_SCHEDULER_DM)
+#define POLICY "DM"
+#elif defined(THREAD_SCHEDULER_CYCLIC)
+#define POLICY "CYCLIC"
+#elif defined(THREAD_SCHEDULER_WRR)
+#define POLICY "WRR"
+#elif defined(THREAD_SCHEDULER_SJF)
+#define POLICY "SJF"
+#elif defined(THREAD_SCHEDULER_MLFQ)
+#define POLICY "MLFQ"
+#elif defined(THREAD_SCHEDULER_CFS)
+#define POLICY "CFS"
+#elif defined(THREAD_SCHEDULER_CBS)
+#define POLICY "CBS"
+#else
+#define POLICY "DEFAULT"
+#endif
+
+static uint64 seed = 1;
+static int harts = 1;
+
+static uint64
+rnd(void)
+{
+    // xorshift64*
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 2685821657736338717UL;
+}
+
+static int
+rnd_range(int lo, int hi)
+{
+    return lo + rnd() % (hi - lo + 1);
+}
+
+// Split `total` into n shares drawn uniformly from the simplex, the
+// distribution UUniFast produces: sort n-1 cut points in [0, total]
+// and take the gaps between them.
+static void
+uunifast(int n, int total, int *share)
+{
+    int cut[MAXTHREADS + 1];
+    int i, j, c;
+
+    for (i = 0; i < n - 1; i++) {
+        c = rnd_range(0, total);
+        for (j = i; j > 0 && cut[j - 1] > c; j--)
+            cut[j] = cut[j - 1];
+        cut[j] = c;
+    }
+    cut[n - 1] = total;
+    for (i = n - 1; i > 0; i--)
+        share[i] = cut[i] - cut[i - 1];
+    share[0] = cut[0];
+}
+
+void f(void *arg)
+{
+    while (1) {
+    }
+}
+
+// Draw a task set with total utilization `u` (per-mille), redrawing
+// it until the utilization after rounding the processing times to
+// whole ticks is within TOLERANCE per hart. Returns that utilization,
+// or -1 if no draw got close enough.
+static int
+draw_taskset(int n, int u, int *period, int *c)
+{
+    int share[MAXTHREADS];
+    int i, t, real;
+
+    for (t = 0; t < TRIES; t++) {
+        uunifast(n, u, share);
+        real = 0;
+        for (i = 0; i < n; i++) {
+            period[i] = rnd_range(PERIOD_MIN, PERIOD_MAX);
+            c[i] = (share[i] * period[i] + 500) / 1000;
+            if (c[i] < 1)
+                c[i] = 1;
+            // in 1/100000, so that truncation does not add up
+            real += c[i] * 100000 / period[i];
+        }
+        real /= 100;
+        if (real >= u - TOLERANCE * harts && real <= u + TOLERANCE * harts)
+            return real;
+    }
+    return -1;
+}
+
+// Run the task set in a child. Returns 1 if the child missed a
+// deadline, 0 otherwise.
+static int
+run_taskset(int n, int *period, int *c)
+{
+    int fds[2], i, pid;
+    char ok = 0;
+
+    if (pipe(fds) < 0) {
+        fprintf(2, "rtbench: pipe failed\n");
+        exit(1);
+    }
+    pid = fork();
+    if (pid < 0) {
+        fprintf(2, "rtbench: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        // keep the trace printed by the runtime off the console
+        close(1);
+        for (i = 0; i < n; i++)
+            thread_add_at(thread_create(f, NULL, 1, c[i], period[i], JOBS), 0);
+        if (harts == 1)
+            thread_start_threading();
+        else if (thread_start_threading_partitioned(harts) < 0)
+            exit(1);
+        // not reached if a deadline was missed
+        write(fds[1], "y", 1);
+        exit(0);
+    }
+
+    close(fds[1]);
+    if (read(fds[0], &ok, 1) != 1)
+        ok = 0;
+    close(fds[0]);
+    wait(0);
+    return ok != 'y';
+}
+
+int main(int argc, char **argv)
+{
+    int n = 8, trials = 5, u, t, misses, real_u, real;
+    int period[MAXTHREADS], c[MAXTHREADS];
+
+    if (argc > 1)
+        n = atoi(argv[1]);
+    if (argc > 2)
+        trials = atoi(argv[2]);
+    if (argc > 3)
+        seed = atoi(argv[3]);
+    if (argc > 4)
+        harts = atoi(argv[4]);
+    if (n < 1 || n > MAXTHREADS || trials < 1 || seed == 0 || harts < 1 || harts > THREAD_MAX_HARTS) {
+        fprintf(2, "usage: rtbench [nthreads(1-%d) [trials [seed [harts(1-%d)]]]]\n", MAXTHREADS,
+                THREAD_MAX_HARTS);
+        exit(1);
+    }
+
+    printf("policy %s, %d threads, %d task sets per utilization, %d harts\n", POLICY, n, trials, harts);
+    printf("target%%  actual%%  missed  miss%%\n");
+    for (u = 500 * harts; u <= 1000 * harts; u += 100 * harts) {
+        misses = 0;
+        real_u = 0;
+        for (t = 0; t < trials; t++) {
+            if ((real = draw_taskset(n, u, period, c)) < 0)
+                break;
+            real_u += real;
+            misses += run_taskset(n, period, c);
+        }
+        if (t < trials) {
+            printf("%d      no set of %d threads within %d.%d%%\n", u / 10, n,
+                   TOLERANCE * harts / 10, TOLERANCE * harts % 10);
+            continue;
+        }
+        printf("%d      %d       %d/%d     %d\n", u / 10, real_u / trials / 10,
+               misses, trials, misses * 100 / trials);
+    }
+    exit(0);
+}
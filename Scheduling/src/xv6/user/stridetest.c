@@ -0,0 +1,131 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// check the proportional share of settickets(): fork spinners
+// with the given tickets, let them all count loop iterations over
+// the same interval, and compare the shares they got with the
+// ones asked for.
+//
+//   stridetest [ticks [tickets...]]     default: 100 3 2 1
+//
+// the spinners must compete for the cpus, so boot with CPUS=1
+// or run more spinners than there are cpus.
+
+#define MAXSPIN 8
+#define NINTERVAL 5
+
+// wait for the start time on go, then count until duration ticks
+// after it, so that the spinners forked first get no head start.
+static int
+spin(int tickets, int duration, int go, int fd)
+{
+  uint64 count[NINTERVAL];
+  int start, now, i;
+  volatile int x = 0;
+
+  if(settickets(tickets) < 0)
+    return -1;
+  for(i = 0; i < NINTERVAL; i++)
+    count[i] = 0;
+  if(read(go, &start, sizeof(start)) != sizeof(start))
+    return -1;
+  while((now = uptime() - start) < duration){
+    if(now < 0)
+      continue;
+    for(i = 0; i < 1000; i++)
+      x++;
+    count[now * NINTERVAL / duration]++;
+  }
+  write(fd, count, sizeof(count));
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  int tickets[MAXSPIN] = {3, 2, 1};
+  int fd[MAXSPIN], start[MAXSPIN];
+  uint64 count[MAXSPIN][NINTERVAL], sum[NINTERVAL + 1], mine;
+  int n = 3, duration = 100, total, fds[2], go[2], i, j;
+
+  if(argc > 1)
+    duration = atoi(argv[1]);
+  if(argc > 2){
+    n = argc - 2;
+    if(n > MAXSPIN){
+      fprintf(2, "stridetest: at most %d spinners\n", MAXSPIN);
+      exit(1);
+    }
+    for(i = 0; i < n; i++)
+      tickets[i] = atoi(argv[i + 2]);
+  }
+  if(duration < NINTERVAL){
+    fprintf(2, "usage: stridetest [ticks(>=%d) [tickets...]]\n", NINTERVAL);
+    exit(1);
+  }
+
+  if(pipe(go) < 0){
+    fprintf(2, "stridetest: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(pipe(fds) < 0){
+      fprintf(2, "stridetest: pipe failed\n");
+      exit(1);
+    }
+    if(fork() == 0){
+      close(fds[0]);
+      close(go[1]);
+      if(spin(tickets[i], duration, go[0], fds[1]) < 0){
+        fprintf(2, "stridetest: spinner with %d tickets failed to start\n", tickets[i]);
+        exit(1);
+      }
+      exit(0);
+    }
+    close(fds[1]);
+    fd[i] = fds[0];
+  }
+  // every spinner is forked: give them all the same start, the
+  // next tick, so that they count over the same intervals.
+  close(go[0]);
+  start[0] = uptime() + 1;
+  for(i = 1; i < n; i++)
+    start[i] = start[0];
+  write(go[1], start, n * sizeof(start[0]));
+  close(go[1]);
+
+  total = 0;
+  for(j = 0; j <= NINTERVAL; j++)
+    sum[j] = 0;
+  for(i = 0; i < n; i++){
+    total += tickets[i];
+    if(read(fd[i], count[i], sizeof(count[i])) != sizeof(count[i])){
+      fprintf(2, "stridetest: spinner %d failed\n", i);
+      for(j = 0; j < NINTERVAL; j++)
+        count[i][j] = 0;
+    }
+    close(fd[i]);
+    wait(0);
+    for(j = 0; j < NINTERVAL; j++){
+      sum[j] += count[i][j];
+      sum[NINTERVAL] += count[i][j];
+    }
+  }
+
+  // shares in per-mille, xv6 user programs have no floating point
+  printf("tickets want");
+  for(j = 0; j < NINTERVAL; j++)
+    printf(" int%d", j);
+  printf(" total\n");
+  for(i = 0; i < n; i++){
+    printf("%d\t%d", tickets[i], total ? tickets[i] * 1000 / total : 0);
+    mine = 0;
+    for(j = 0; j < NINTERVAL; j++){
+      mine += count[i][j];
+      printf(" %d", sum[j] ? (int)(count[i][j] * 1000 / sum[j]) : 0);
+    }
+    printf(" %d\n", sum[NINTERVAL] ? (int)(mine * 1000 / sum[NINTERVAL]) : 0);
+  }
+  exit(0);
+}
@@ -0,0 +1,67 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/threads.h"
+
+// Bounded buffer shared by producer and consumer threads, to exercise
+// thread_mutex and thread_sem: a thread waiting for a slot or an item
+// is blocked instead of spinning through its slices.
+
+#define NULL 0
+#define SLOTS 4
+#define ITEMS 200
+#define PRODUCERS 2
+#define CONSUMERS 2
+
+int buf[SLOTS];
+int in = 0, out = 0;
+int consumed = 0, sum = 0;
+
+struct thread_mutex lock;
+struct thread_sem empty, full;
+
+void producer(void *arg)
+{
+    int base = (int)(uint64)arg;
+    for (int i = 1; i <= ITEMS; i++) {
+        thread_sem_down(&empty);
+        thread_mutex_lock(&lock);
+        buf[in] = base + i;
+        in = (in + 1) % SLOTS;
+        thread_mutex_unlock(&lock);
+        thread_sem_up(&full);
+    }
+}
+
+void consumer(void *arg)
+{
+    for (int i = 0; i < ITEMS * PRODUCERS / CONSUMERS; i++) {
+        thread_sem_down(&full);
+        thread_mutex_lock(&lock);
+        sum += buf[out];
+        out = (out + 1) % SLOTS;
+        ++consumed;
+        thread_mutex_unlock(&lock);
+        thread_sem_up(&empty);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int i, expected = 0;
+
+    thread_mutex_init(&lock);
+    thread_sem_init(&empty, SLOTS);
+    thread_sem_init(&full, 0);
+
+    for (i = 0; i < PRODUCERS; i++) {
+        thread_add_at(thread_create(producer, (void *)(uint64)(i * 1000), 0, 1000, -1, 1), 0);
+        expected += i * 1000 * ITEMS + ITEMS * (ITEMS + 1) / 2;
+    }
+    for (i = 0; i < CONSUMERS; i++)
+        thread_add_at(thread_create(consumer, NULL, 0, 1000, -1, 1), 0);
+
+    thread_start_threading();
+    printf("\nconsumed %d items, sum %d, expected %d: %s\n", consumed, sum, expected,
+           consumed == ITEMS * PRODUCERS && sum == expected ? "OK" : "FAIL");
+    exit(0);
+}
@@ -3,29 +3,343 @@
 #include "user/threads_sched.h"
 #include "user/user.h"
 #include "user/list.h"
+#include "kernel/fcntl.h"
 
 #define NULL 0
 #define TIME_QUANTUM 2
 
-static LIST_HEAD(run_queue);
-static LIST_HEAD(release_queue);
+// heap reserved before the harts start sharing memory, and the stack of
+// each hart's scheduler loop
+#ifndef THREAD_HART_HEAP
+#define THREAD_HART_HEAP (64 * 1024)
+#endif
+#define THREAD_HART_STACK 4096
+
+static int overload_policy = THREAD_OVERLOAD_EXIT;
+
+// aperiodic jobs from thread_submit(), oldest first
+struct aperiodic_job {
+    void (*fp)(void *arg);
+    void *arg;
+    int seq;
+    int submit_time;
+    struct list_head list;
+    // in a hart's job_inbox
+    struct aperiodic_job *inbox_next;
+};
+static int aperiodic_seq = 0;
+// the first server created; thread_submit() queues jobs on its hart
+static struct thread *aperiodic_server = NULL;
+static int aperiodic_hart = 0;
+// the background server lives here instead of in the run queue, and is
+// only dispatched in time the policy leaves idle
+static struct thread *background_server = NULL;
+static LIST_HEAD(background_queue);
+
+// scheduler state of one hart. the runtime runs on harts[0] only,
+// unless thread_start_threading_partitioned() gives each hart its own
+// kernel thread with clone(); the tp register holds the hart index.
+struct hart {
+    struct list_head run_queue;
+    struct list_head release_queue;
+    struct list_head *current;
+    int threading_system_time;
+    int main_thrd_id;
+    int sleeping;
+    uint64 allocated_time;
+    // threads sitting in wait queues, reported if threading ends without them
+    int nr_blocked;
+    // sporadic threads between jobs, waiting for thread_release_now()
+    struct list_head sporadic_idle;
+    struct list_head aperiodic_queue;
+    // threads whose last job was dropped, freed from the main thread's stack
+    struct list_head dropped_threads;
+    // releases and aperiodic jobs posted by other harts, pushed without
+    // locks and taken over by __release()
+    struct thread *release_inbox;
+    struct aperiodic_job *job_inbox;
+    int pid;
+};
+
+static struct hart harts[THREAD_MAX_HARTS];
+static int nharts = 1;
+// serializes malloc() and free() while several harts run
+static int heap_lock = 0;
+
+struct hart *__hart(int id)
+{
+    struct hart *h = &harts[id];
+    if (h->run_queue.next == NULL) {
+        INIT_LIST_HEAD(&h->run_queue);
+        INIT_LIST_HEAD(&h->release_queue);
+        INIT_LIST_HEAD(&h->sporadic_idle);
+        INIT_LIST_HEAD(&h->aperiodic_queue);
+        INIT_LIST_HEAD(&h->dropped_threads);
+        h->main_thrd_id = -1;
+    }
+    return h;
+}
+
+// the hart the caller runs on; exec() clears tp, so it is 0 in a
+// program that never calls thread_start_threading_partitioned()
+struct hart *myhart(void)
+{
+    uint64 id;
+    asm volatile("mv %0, tp"
+                 : "=r"(id));
+    return __hart(id);
+}
 
-static struct list_head *current = NULL;
-static int threading_system_time = 0;
-static int main_thrd_id = -1;
-static int sleeping = 0;
-static uint64 allocated_time = 0;
+// the hart `t` runs on. until threading starts on several harts, and
+// for threads created after that, it is the caller's
+struct hart *__thread_hart(struct thread *t)
+{
+    if (nharts == 1 || t->hart < 0)
+        return myhart();
+    return __hart(t->hart);
+}
+
+void *__malloc(uint size)
+{
+    if (nharts == 1)
+        return malloc(size);
+    while (__sync_lock_test_and_set(&heap_lock, 1))
+        ;
+    void *p = malloc(size);
+    __sync_lock_release(&heap_lock);
+    return p;
+}
+
+void __free(void *p)
+{
+    if (nharts == 1) {
+        free(p);
+        return;
+    }
+    while (__sync_lock_test_and_set(&heap_lock, 1))
+        ;
+    free(p);
+    __sync_lock_release(&heap_lock);
+}
+
+// scheduling trace, kept in a ring while threading so that no
+// console output slows down the schedule being traced. the events
+// are printed in the console format the grading scripts match in
+// batches as the ring fills up, and at the end; the last
+// THREAD_TRACE_SIZE also go to the binary trace file. events ever
+// recorded, harts reserve their slot atomically, and printed
+static struct thread_trace_event trace[THREAD_TRACE_SIZE];
+static int trace_total = 0;
+static int trace_printed = 0;
+static char *trace_path = NULL;
+static int print_lock = 0;
 
 void __dispatch(void);
 void __schedule(void);
+void switch_handler(void *arg);
+void __finish_current(void);
+void __rt_finish_current(void);
+
+void __trace_print(struct thread_trace_event *e)
+{
+    switch (e->type) {
+    case THREAD_TRACE_DISPATCH:
+        printf("dispatch thread#%d at %d: allocated_time=%d\n", e->ID, e->time, e->allocated_time);
+        break;
+    case THREAD_TRACE_FINISH:
+        printf("thread#%d finish at %d\n", e->ID, e->time);
+        break;
+    case THREAD_TRACE_RT_FINISH:
+        printf("thread#%d finish one cycle at %d: %d cycles left\n", e->ID, e->time, e->n);
+        break;
+    case THREAD_TRACE_SLEEP:
+        printf("run_queue is empty, sleep for %d ticks\n", e->allocated_time);
+        break;
+    case THREAD_TRACE_MISS:
+        printf("thread#%d misses a deadline at %d\n", e->ID, e->time);
+        break;
+    case THREAD_TRACE_DROP:
+        printf("thread#%d drops a job at %d: %d cycles left\n", e->ID, e->time, e->n);
+        break;
+    case THREAD_TRACE_APERIODIC:
+        printf("aperiodic job %d done at %d: response time %d\n", e->n, e->time, e->allocated_time);
+        break;
+    }
+}
+
+// print the events recorded before `end` that are not printed yet;
+// one hart at a time, since printf writes a character at a time
+void __trace_print_until(int end)
+{
+    if (nharts > 1)
+        while (__sync_lock_test_and_set(&print_lock, 1))
+            ;
+    for (; trace_printed < end; trace_printed++)
+        __trace_print(&trace[trace_printed % THREAD_TRACE_SIZE]);
+    if (nharts > 1)
+        __sync_lock_release(&print_lock);
+}
+
+void __trace(int type, int id, int time, int allocated, int n)
+{
+    int i = __sync_fetch_and_add(&trace_total, 1);
+    struct thread_trace_event *e = &trace[i % THREAD_TRACE_SIZE];
+    e->type = type;
+    e->ID = id;
+    e->time = time;
+    e->allocated_time = allocated;
+    e->n = n;
+    e->hart = myhart() - harts;
+    // every half ring, print up to a quarter ring back: the other
+    // harts may still be filling in the slots they reserved last,
+    // and the ring does not wrap onto what is left unprinted
+    if ((i + 1) % (THREAD_TRACE_SIZE / 2) == 0)
+        __trace_print_until(i + 1 - THREAD_TRACE_SIZE / 4);
+}
+
+static struct thread_stats stats[THREAD_STATS_MAX];
+
+void __hist_add(struct thread_hist *h, int v)
+{
+    int b = 0;
+    while (b < THREAD_HIST_BUCKETS - 1 && v >= (1 << b))
+        ++b;
+    if (h->count == 0 || v > h->max)
+        h->max = v;
+    ++h->count;
+    h->sum += v;
+    ++h->bucket[b];
+}
+
+// upper bound of the bucket holding the `pct` percentile; the last
+// bucket is open-ended, so report the maximum for it
+int __hist_percentile(struct thread_hist *h, int pct)
+{
+    int want = (h->count * pct + 99) / 100, seen = 0, b;
+    for (b = 0; b < THREAD_HIST_BUCKETS - 1; b++) {
+        seen += h->bucket[b];
+        if (seen >= want)
+            break;
+    }
+    if (b == 0)
+        return h->max < 0 ? h->max : 0;
+    if (b == THREAD_HIST_BUCKETS - 1 || (1 << b) - 1 > h->max)
+        return h->max;
+    return (1 << b) - 1;
+}
+
+struct thread_stats *__stats(struct thread *t)
+{
+    if (t->ID >= THREAD_STATS_MAX)
+        return NULL;
+    struct thread_stats *st = &stats[t->ID];
+    st->ID = t->ID;
+    st->is_real_time = t->is_real_time;
+    return st;
+}
+
+struct thread_stats *thread_stats(int id)
+{
+    if (id <= 0 || id >= THREAD_STATS_MAX || stats[id].ID != id)
+        return NULL;
+    return &stats[id];
+}
+
+// the current job of `t` completed at threading_system_time
+void __stats_finish(struct thread *t)
+{
+    struct hart *h = myhart();
+    struct thread_stats *st = __stats(t);
+    if (st == NULL || t == background_server)
+        return;
+    ++st->jobs;
+    __hist_add(&st->response, h->threading_system_time - t->job_release);
+    __hist_add(&st->waiting, (t->job_start >= 0 ? t->job_start : h->threading_system_time) - t->job_release);
+    if (t->is_real_time)
+        __hist_add(&st->slack, t->current_deadline - h->threading_system_time);
+    __hist_add(&st->preemptions, t->job_preemptions);
+}
+
+void __report_hist(char *name, struct thread_hist *h)
+{
+    if (h->count == 0)
+        return;
+    printf("  %s: p50 %d, p90 %d, p99 %d, max %d, avg %d\n", name, __hist_percentile(h, 50),
+           __hist_percentile(h, 90), __hist_percentile(h, 99), h->max, h->sum / h->count);
+}
+
+void thread_sched_report(void)
+{
+    for (int i = 1; i < THREAD_STATS_MAX; i++) {
+        struct thread_stats *st = &stats[i];
+        if (st->ID != i)
+            continue;
+        printf("thread#%d (%s): %d jobs, %d misses, %d dropped\n", i,
+               st->is_real_time ? "real-time" : "non-real-time", st->jobs, st->misses, st->dropped);
+        __report_hist("response   ", &st->response);
+        __report_hist("waiting    ", &st->waiting);
+        __report_hist("slack      ", &st->slack);
+        __report_hist("preemptions", &st->preemptions);
+    }
+}
+
+void thread_trace_file(char *path)
+{
+    trace_path = path;
+}
+
+int thread_trace_dump(int fd)
+{
+    int count = trace_total < THREAD_TRACE_SIZE ? trace_total : THREAD_TRACE_SIZE;
+    struct thread_trace_header h = {
+        .magic = THREAD_TRACE_MAGIC,
+        .size = sizeof(struct thread_trace_event),
+        .count = count,
+        .dropped = trace_total - count,
+    };
+    int first = (trace_total - count) % THREAD_TRACE_SIZE;
+    int len = count;
+
+    if (write(fd, &h, sizeof(h)) != sizeof(h))
+        return -1;
+    if (first + len > THREAD_TRACE_SIZE) {
+        int tail = THREAD_TRACE_SIZE - first;
+        if (write(fd, &trace[first], tail * sizeof(struct thread_trace_event)) != tail * sizeof(struct thread_trace_event))
+            return -1;
+        first = 0;
+        len -= tail;
+    }
+    if (write(fd, &trace[first], len * sizeof(struct thread_trace_event)) != len * sizeof(struct thread_trace_event))
+        return -1;
+    return 0;
+}
+
+// print the events not printed yet, and write the binary trace if
+// thread_trace_file() was called
+void __trace_flush()
+{
+    __trace_print_until(trace_total);
+    if (trace_path != NULL) {
+        if (trace_total > THREAD_TRACE_SIZE)
+            fprintf(2, "[WARN] trace ring full, %d oldest events left out of %s\n",
+                    trace_total - THREAD_TRACE_SIZE, trace_path);
+        int fd = open(trace_path, O_CREATE | O_WRONLY | O_TRUNC);
+        if (fd < 0 || thread_trace_dump(fd) < 0)
+            fprintf(2, "[ERROR] cannot write trace to %s\n", trace_path);
+        if (fd >= 0)
+            close(fd);
+    }
+    trace_total = 0;
+    trace_printed = 0;
+}
 
 struct thread *thread_create(void (*f)(void *), void *arg, int is_real_time, int processing_time, int period, int n)
 {
     static int _id = 1;
-    struct thread *t = (struct thread *)malloc(sizeof(struct thread));
+    struct thread *t = (struct thread *)__malloc(sizeof(struct thread));
     unsigned long new_stack_p;
     unsigned long new_stack;
-    new_stack = (unsigned long)malloc(sizeof(unsigned long) * 0x200);
+    new_stack = (unsigned long)__malloc(sizeof(unsigned long) * 0x200);
     new_stack_p = new_stack + 0x200 * 8 - 0x2 * 8;
     t->fp = f;
     t->arg = arg;
@@ -42,63 +356,740 @@ struct thread *thread_create(void (*f)(void *), void *arg, int is_real_time, int
     t->weight = 1;
     t->remaining_time = processing_time;
     t->current_deadline = 0;
+    t->mlfq_level = 0;
+    t->mlfq_allocated = 0;
+    t->mlfq_dispatch_remaining = 0;
+    t->vruntime = 0;
+    t->cfs_dispatch_remaining = 0;
+    t->value = 1;
+    t->misses = 0;
+    t->dropped = 0;
+    t->blocked = 0;
+    t->pi_deadline = 0;
+    t->pi_current_deadline = 0;
+    INIT_LIST_HEAD(&t->pi_held);
+    t->pi_blocked_on = NULL;
+    t->sporadic = 0;
+    t->parked = 0;
+    t->job_release = 0;
+    t->job_start = -1;
+    t->job_preemptions = 0;
+    t->hart = -1;
+    t->release_posted = 0;
+    t->inbox_next = NULL;
     return t;
 }
 
+// end the process after printing the trace. with several harts, the
+// first one to get here does it, and kills hart 0 so that the kernel
+// kills the other harts
+void __exit_threading(void)
+{
+    static int exiting = 0;
+
+    if (!__sync_bool_compare_and_swap(&exiting, 0, 1)) {
+        // another hart is printing the trace and ending the process
+        for (;;)
+            sleep(100);
+    }
+    __trace_flush();
+    if (myhart() != &harts[0])
+        kill(harts[0].pid);
+    exit(0);
+}
+
 void thread_set_weight(struct thread *t, int weight)
 {
     t->weight = weight;
 }
 
+void thread_set_value(struct thread *t, int value)
+{
+    t->value = value;
+}
+
+void thread_set_overload(int policy)
+{
+    overload_policy = policy;
+}
+
+void thread_set_server(int budget, int period)
+{
+    schedule_cbs_set_server(budget, period);
+}
+
 void thread_add_at(struct thread *t, int arrival_time)
 {
-    struct release_queue_entry *new_entry = (struct release_queue_entry *)malloc(sizeof(struct release_queue_entry));
+    struct hart *h = __thread_hart(t);
+    if (nharts > 1)
+        t->hart = h - harts;
+    struct release_queue_entry *new_entry = (struct release_queue_entry *)__malloc(sizeof(struct release_queue_entry));
     new_entry->thrd = t;
     new_entry->release_time = arrival_time;
     if (t->is_real_time) {
         t->current_deadline = arrival_time;
         t->current_deadline = arrival_time + t->deadline;
     }
-    list_add_tail(&new_entry->thread_list, &release_queue);
+    list_add_tail(&new_entry->thread_list, &h->release_queue);
+}
+
+// policies that keep their own index of the runnable threads are told
+// whenever a thread enters or leaves the run queue
+void __enqueue(struct thread *t)
+{
+    struct hart *h = myhart();
+    list_add_tail(&t->thread_list, &h->run_queue);
+#ifdef THREAD_SCHEDULER_CFS
+    schedule_cfs_enqueue(t);
+#endif
+}
+
+void __dequeue(struct thread *t)
+{
+#ifdef THREAD_SCHEDULER_CFS
+    schedule_cfs_dequeue(t);
+#endif
+    list_del(&t->thread_list);
+}
+
+// the job of `t` is over and `t` has left the run queue: queue its next
+// release, or park it until thread_release_now() if it is sporadic
+void __next_job(struct thread *t, int next_release)
+{
+    struct hart *h = __thread_hart(t);
+    if (t->sporadic) {
+        list_add_tail(&t->thread_list, &h->sporadic_idle);
+        t->parked = 1;
+    } else {
+        thread_add_at(t, next_release);
+    }
+}
+
+// put the thread that was running back at the end of its queue
+void __requeue(struct thread *t)
+{
+    struct hart *h = myhart();
+    list_del(&t->thread_list);
+    list_add_tail(&t->thread_list, t == background_server ? &background_queue : &h->run_queue);
+}
+
+// 1 while some thread can still be released or dispatched
+int __has_work()
+{
+    struct hart *h = myhart();
+    return !list_empty(&h->run_queue) || !list_empty(&h->release_queue)
+           || (background_server != NULL && h == &harts[0] && !list_empty(&h->aperiodic_queue));
+}
+
+// release sporadic thread `t` of hart `h` as soon as its period
+// allows; returns the release time, -1 if its last job is still pending
+int __release_now(struct hart *h, struct thread *t)
+{
+    if (!t->sporadic || !t->parked)
+        return -1;
+    // at least one period after the previous release
+    int at = t->current_deadline - t->deadline + t->period;
+    if (at < h->threading_system_time)
+        at = h->threading_system_time;
+    list_del(&t->thread_list);
+    t->parked = 0;
+    thread_add_at(t, at);
+    return at;
+}
+
+// the inboxes are lock-free stacks: other harts push with a CAS, and
+// the owner takes the whole stack at once and reverses it to get the
+// posting order
+int __post_release(struct hart *h, struct thread *t)
+{
+    struct thread *head;
+
+    if (!t->sporadic || !t->parked || !__sync_bool_compare_and_swap(&t->release_posted, 0, 1))
+        return -1;
+    do {
+        head = h->release_inbox;
+        t->inbox_next = head;
+    } while (!__sync_bool_compare_and_swap(&h->release_inbox, head, t));
+    return 0;
+}
+
+void __post_job(struct hart *h, struct aperiodic_job *job)
+{
+    struct aperiodic_job *head;
+
+    do {
+        head = h->job_inbox;
+        job->inbox_next = head;
+    } while (!__sync_bool_compare_and_swap(&h->job_inbox, head, job));
+}
+
+void __drain_inboxes(struct hart *h)
+{
+    struct thread *t, *prev = NULL, *next;
+    struct aperiodic_job *job, *jprev = NULL, *jnext;
+
+    for (t = __sync_lock_test_and_set(&h->release_inbox, NULL); t != NULL; t = next) {
+        next = t->inbox_next;
+        t->inbox_next = prev;
+        prev = t;
+    }
+    for (t = prev; t != NULL; t = next) {
+        next = t->inbox_next;
+        t->inbox_next = NULL;
+        __release_now(h, t);
+        __sync_lock_release(&t->release_posted);
+    }
+
+    for (job = __sync_lock_test_and_set(&h->job_inbox, NULL); job != NULL; job = jnext) {
+        jnext = job->inbox_next;
+        job->inbox_next = jprev;
+        jprev = job;
+    }
+    for (job = jprev; job != NULL; job = jnext) {
+        jnext = job->inbox_next;
+        list_add_tail(&job->list, &h->aperiodic_queue);
+    }
 }
 
 void __release()
 {
+    struct hart *h = myhart();
     struct release_queue_entry *cur, *nxt;
-    list_for_each_entry_safe(cur, nxt, &release_queue, thread_list) {
-        if (threading_system_time >= cur->release_time) {
+    if (nharts > 1)
+        __drain_inboxes(h);
+    list_for_each_entry_safe(cur, nxt, &h->release_queue, thread_list) {
+        if (h->threading_system_time >= cur->release_time) {
             cur->thrd->remaining_time = cur->thrd->processing_time;
             cur->thrd->current_deadline = cur->release_time + cur->thrd->deadline;
-            list_add_tail(&cur->thrd->thread_list, &run_queue);
+            __trace(THREAD_TRACE_RELEASE, cur->thrd->ID, cur->release_time, cur->thrd->deadline, cur->thrd->n);
+            cur->thrd->job_release = cur->release_time;
+            cur->thrd->job_start = -1;
+            cur->thrd->job_preemptions = 0;
+            // every job of a periodic thread enters MLFQ at the top level
+            cur->thrd->mlfq_level = 0;
+            cur->thrd->mlfq_allocated = 0;
+            __enqueue(cur->thrd);
             list_del(&cur->thread_list);
-            free(cur);
+            __free(cur);
         }
     }
 }
 
 void __thread_exit(struct thread *to_remove)
 {
-    current = to_remove->thread_list.prev;
-    list_del(&to_remove->thread_list);
+    struct hart *h = myhart();
+    h->current = to_remove->thread_list.prev;
+    __dequeue(to_remove);
+#ifdef THREAD_SCHEDULER_CYCLIC
+    schedule_cyclic_exit(to_remove);
+#endif
+
+    __free(to_remove->stack);
+    __free(to_remove);
+
+    __schedule();
+    __dispatch();
+    thrdresume(h->main_thrd_id);
+}
+
+// give up the current job of `t` without completing it. the thread is
+// released again at `next_release` if it has jobs left, otherwise it is
+// freed later by __reap(), since we may be running on its stack
+void __drop(struct thread *t, int next_release)
+{
+    struct hart *h = myhart();
+    --t->n;
+    ++t->dropped;
+    if (__stats(t) != NULL)
+        ++__stats(t)->dropped;
+    __trace(THREAD_TRACE_DROP, t->ID, h->threading_system_time, 0, t->n);
+
+    if (h->current == &t->thread_list)
+        h->current = h->current->prev;
+    __dequeue(t);
+
+    if (t->n > 0) {
+        __next_job(t, next_release);
+        return;
+    }
+#ifdef THREAD_SCHEDULER_CYCLIC
+    schedule_cyclic_exit(t);
+#endif
+    if (t->buf_set)
+        cancelthrdstop(t->thrdstop_context_id, 1);
+    list_add_tail(&t->thread_list, &h->dropped_threads);
+}
+
+void __reap()
+{
+    struct hart *h = myhart();
+    struct thread *t, *nt;
+    list_for_each_entry_safe(t, nt, &h->dropped_threads, thread_list) {
+        list_del(&t->thread_list);
+        __free(t->stack);
+        __free(t);
+    }
+}
+
+// the current job of real-time thread `t` missed its deadline
+void __overload(struct thread *t)
+{
+    struct hart *h = myhart();
+    int release = t->current_deadline - t->deadline;
+    int next_release = release + t->period;
+
+    ++t->misses;
+    if (__stats(t) != NULL)
+        ++__stats(t)->misses;
+    if (overload_policy == THREAD_OVERLOAD_EXIT)
+        __exit_threading();
+
+    if (overload_policy == THREAD_OVERLOAD_DEGRADE) {
+        t->period *= 2;
+        t->deadline *= 2;
+    }
+    __drop(t, next_release);
+
+    if (overload_policy == THREAD_OVERLOAD_ABORT) {
+        // shed the least valuable work left, latest deadline first on ties
+        struct thread *victim = NULL, *th;
+        list_for_each_entry(th, &h->run_queue, thread_list) {
+            if (!th->is_real_time || th->value >= t->value)
+                continue;
+            if (victim == NULL || th->value < victim->value ||
+                (th->value == victim->value && th->current_deadline > victim->current_deadline))
+                victim = th;
+        }
+        if (victim != NULL)
+            __drop(victim, victim->current_deadline - victim->deadline + victim->period);
+    }
+}
+
+// the wait queue and synchronization calls stop the running thread's
+// thrdstop timer while they touch the queues, so switch_handler() can
+// not run in the middle of a list update. the ticks used so far are
+// charged here and the rest of the slice is re-armed afterwards.
+// returns NULL, doing nothing, when called from the main thread.
+struct thread *__preempt_disable(void)
+{
+    struct hart *h = myhart();
+    if (h->current == NULL || h->current == &h->run_queue)
+        return NULL;
+
+    struct thread *t = list_entry(h->current, struct thread, thread_list);
+    uint64 consumed = cancelthrdstop(t->thrdstop_context_id, 0);
+    h->threading_system_time += consumed;
+    t->remaining_time -= consumed;
+    h->allocated_time = consumed < h->allocated_time ? h->allocated_time - consumed : 1;
+    return t;
+}
+
+void __preempt_enable(struct thread *t)
+{
+    struct hart *h = myhart();
+    if (t != NULL)
+        thrdstop(h->allocated_time, &t->thrdstop_context_id, switch_handler, (void *)h->allocated_time);
+}
+
+#define SWITCH_YIELD  0 // stay runnable, at the end of the run queue
+#define SWITCH_BLOCK  1 // wait in `wait_queue`
+#define SWITCH_FINISH 2 // end the current job now
+
+// with preemption disabled, take the running thread off the CPU as `how`
+// says and run something else. returns once the thread is dispatched
+// again, with preemption enabled.
+void __switch_out(struct thread *t, int how, struct list_head *wait_queue)
+{
+    struct hart *h = myhart();
+    volatile int resumed = 0;
+
+    // save the context to resume from; thrdresume() returns here again
+    cancelthrdstop(t->thrdstop_context_id, 0);
+    if (resumed)
+        return;
+    resumed = 1;
 
-    free(to_remove->stack);
-    free(to_remove);
+    if (how == SWITCH_FINISH) {
+        if (t->is_real_time)
+            __rt_finish_current();
+        else
+            __finish_current();
+    } else if (how == SWITCH_BLOCK) {
+        h->current = h->current->prev;
+        __dequeue(t);
+        list_add_tail(&t->thread_list, wait_queue);
+        t->blocked = 1;
+        ++h->nr_blocked;
+    } else {
+        h->current = h->current->prev;
+        ++t->job_preemptions;
+        __requeue(t);
+    }
 
+    __release();
     __schedule();
     __dispatch();
-    thrdresume(main_thrd_id);
+    thrdresume(h->main_thrd_id);
+}
+
+void __block(struct thread *t, struct list_head *wait_queue, char *what)
+{
+    if (t == NULL) {
+        fprintf(2, "[FATAL] %s would block the main thread\n", what);
+        exit(1);
+    }
+    __switch_out(t, SWITCH_BLOCK, wait_queue);
+}
+
+// wake up the first thread in `wait_queue`, which must not be empty
+struct thread *__wake_one(struct list_head *wait_queue)
+{
+    struct hart *h = myhart();
+    struct thread *t = list_entry(wait_queue->next, struct thread, thread_list);
+    list_del(&t->thread_list);
+    t->blocked = 0;
+    --h->nr_blocked;
+    __enqueue(t);
+    return t;
+}
+
+void thread_block(struct list_head *wait_queue)
+{
+    __block(__preempt_disable(), wait_queue, "thread_block");
+}
+
+int thread_wakeup(struct list_head *wait_queue)
+{
+    struct thread *self = __preempt_disable();
+    int n = 0;
+
+    while (!list_empty(wait_queue)) {
+        __wake_one(wait_queue);
+        ++n;
+    }
+    __preempt_enable(self);
+    return n;
+}
+
+void thread_mutex_init(struct thread_mutex *m)
+{
+    m->owner = NULL;
+    INIT_LIST_HEAD(&m->waiters);
+}
+
+void thread_mutex_lock(struct thread_mutex *m)
+{
+    struct thread *t = __preempt_disable();
+
+    if (m->owner == NULL) {
+        m->owner = t;
+        __preempt_enable(t);
+        return;
+    }
+    // thread_mutex_unlock() makes us the owner before waking us up
+    __block(t, &m->waiters, "thread_mutex_lock");
+}
+
+void thread_mutex_unlock(struct thread_mutex *m)
+{
+    struct thread *t = __preempt_disable();
+
+    if (t == NULL || m->owner != t) {
+        fprintf(2, "[FATAL] thread_mutex_unlock is called by a thread that does not own the mutex\n");
+        exit(1);
+    }
+    m->owner = NULL;
+    if (!list_empty(&m->waiters))
+        m->owner = __wake_one(&m->waiters);
+    __preempt_enable(t);
+}
+
+void thread_sem_init(struct thread_sem *s, int count)
+{
+    s->count = count;
+    INIT_LIST_HEAD(&s->waiters);
+}
+
+void thread_sem_down(struct thread_sem *s)
+{
+    struct thread *t = __preempt_disable();
+
+    if (s->count > 0) {
+        --s->count;
+        __preempt_enable(t);
+        return;
+    }
+    // thread_sem_up() passes its count to us instead of incrementing it
+    __block(t, &s->waiters, "thread_sem_down");
+}
+
+void thread_sem_up(struct thread_sem *s)
+{
+    struct thread *t = __preempt_disable();
+
+    if (list_empty(&s->waiters))
+        ++s->count;
+    else
+        __wake_one(&s->waiters);
+    __preempt_enable(t);
+}
+
+// 1 if real-time thread `a` is more urgent than `b` under the policy
+// this runtime is built with
+int __pi_before(struct thread *a, struct thread *b)
+{
+#ifdef THREAD_SCHEDULER_DM
+    if (thread_sched_deadline(a) != thread_sched_deadline(b))
+        return thread_sched_deadline(a) < thread_sched_deadline(b);
+#else
+    if (thread_sched_current_deadline(a) != thread_sched_current_deadline(b))
+        return thread_sched_current_deadline(a) < thread_sched_current_deadline(b);
+#endif
+    return a->ID < b->ID;
+}
+
+// the most urgent real-time thread waiting for `m`, NULL if none
+struct thread *__pi_top_waiter(struct thread_rt_mutex *m)
+{
+    struct thread *w, *top = NULL;
+    list_for_each_entry(w, &m->waiters, thread_list) {
+        if (w->is_real_time && (top == NULL || __pi_before(w, top)))
+            top = w;
+    }
+    return top;
+}
+
+// recompute what `t` inherits from the waiters of the rt_mutexes it holds
+void __pi_update(struct thread *t)
+{
+    struct thread_rt_mutex *m;
+    int d = 0, cd = 0;
+
+    list_for_each_entry(m, &t->pi_held, held_node) {
+        struct thread *w = __pi_top_waiter(m);
+        if (w == NULL)
+            continue;
+        if (d == 0 || thread_sched_deadline(w) < d)
+            d = thread_sched_deadline(w);
+        if (cd == 0 || thread_sched_current_deadline(w) < cd)
+            cd = thread_sched_current_deadline(w);
+    }
+    t->pi_deadline = d;
+    t->pi_current_deadline = cd;
+}
+
+// real-time thread `w` starts waiting for an rt_mutex held by `owner`:
+// raise the owner, and the owners it is itself waiting for, to `w`
+void __pi_boost(struct thread *owner, struct thread *w)
+{
+    int d = thread_sched_deadline(w), cd = thread_sched_current_deadline(w);
+
+    while (owner != NULL) {
+        if (owner->pi_deadline == 0 || d < owner->pi_deadline)
+            owner->pi_deadline = d;
+        if (owner->pi_current_deadline == 0 || cd < owner->pi_current_deadline)
+            owner->pi_current_deadline = cd;
+        owner = owner->pi_blocked_on != NULL ? owner->pi_blocked_on->owner : NULL;
+    }
+}
+
+void thread_rt_mutex_init(struct thread_rt_mutex *m)
+{
+    m->owner = NULL;
+    INIT_LIST_HEAD(&m->waiters);
+    INIT_LIST_HEAD(&m->held_node);
+}
+
+void thread_rt_mutex_lock(struct thread_rt_mutex *m)
+{
+    struct thread *t = __preempt_disable();
+
+    if (t == NULL) {
+        fprintf(2, "[FATAL] thread_rt_mutex_lock is called outside a thread\n");
+        exit(1);
+    }
+    if (m->owner == NULL) {
+        m->owner = t;
+        list_add_tail(&m->held_node, &t->pi_held);
+        __preempt_enable(t);
+        return;
+    }
+    if (m->owner == t) {
+        fprintf(2, "[FATAL] thread#%d locks an rt_mutex it already holds\n", t->ID);
+        exit(1);
+    }
+
+    t->pi_blocked_on = m;
+    if (t->is_real_time)
+        __pi_boost(m->owner, t);
+    // thread_rt_mutex_unlock() makes us the owner before waking us up
+    __block(t, &m->waiters, "thread_rt_mutex_lock");
+}
+
+void thread_rt_mutex_unlock(struct thread_rt_mutex *m)
+{
+    struct thread *t = __preempt_disable();
+
+    if (t == NULL || m->owner != t) {
+        fprintf(2, "[FATAL] thread_rt_mutex_unlock is called by a thread that does not own the mutex\n");
+        exit(1);
+    }
+    list_del(&m->held_node);
+    m->owner = NULL;
+    struct thread *next = NULL;
+    if (!list_empty(&m->waiters)) {
+        next = __pi_top_waiter(m);
+        if (next == NULL)
+            next = list_entry(m->waiters.next, struct thread, thread_list);
+        // move it to the head so __wake_one() picks it
+        list_move(&next->thread_list, &m->waiters);
+        __wake_one(&m->waiters);
+        next->pi_blocked_on = NULL;
+        m->owner = next;
+        list_add_tail(&m->held_node, &next->pi_held);
+        // the remaining waiters are now inherited by the new owner
+        __pi_update(next);
+    }
+    // drop what we inherited through `m`, and let the new owner run right
+    // away if that leaves it more urgent than us
+    __pi_update(t);
+    if (next != NULL && next->is_real_time && t->is_real_time && __pi_before(next, t))
+        __switch_out(t, SWITCH_YIELD, NULL);
+    else
+        __preempt_enable(t);
+}
+
+void thread_finish_job(void)
+{
+    struct thread *t = __preempt_disable();
+
+    if (t == NULL) {
+        fprintf(2, "[FATAL] thread_finish_job is called outside a thread\n");
+        exit(1);
+    }
+    __switch_out(t, SWITCH_FINISH, NULL);
+}
+
+void thread_set_sporadic(struct thread *t)
+{
+    struct hart *h = __thread_hart(t);
+    if (nharts > 1)
+        t->hart = h - harts;
+    t->sporadic = 1;
+    // the first job may be released right away
+    t->current_deadline = t->deadline - t->period;
+    list_add_tail(&t->thread_list, &h->sporadic_idle);
+    t->parked = 1;
+}
+
+int thread_release_now(struct thread *t)
+{
+    struct hart *h = myhart();
+    // a thread of another hart is released there, at its next
+    // scheduling point
+    if (__thread_hart(t) != h)
+        return __post_release(__thread_hart(t), t);
+
+    struct thread *self = __preempt_disable();
+    int at = __release_now(h, t);
+    if (at < 0) {
+        __preempt_enable(self);
+        return -1;
+    }
+    if (self == NULL)
+        return 0;
+    __release();
+    // a real-time job out now may be more urgent than the caller
+    if (at == h->threading_system_time && t->is_real_time)
+        __switch_out(self, SWITCH_YIELD, NULL);
+    else
+        __preempt_enable(self);
+    return 0;
+}
+
+int thread_submit(void (*f)(void *), void *arg)
+{
+    struct hart *h = myhart();
+    struct thread *self = __preempt_disable();
+    struct aperiodic_job *job = (struct aperiodic_job *)__malloc(sizeof(struct aperiodic_job));
+    int seq = -1;
+
+    if (job != NULL) {
+        job->fp = f;
+        job->arg = arg;
+        job->seq = seq = __sync_add_and_fetch(&aperiodic_seq, 1);
+        job->submit_time = h->threading_system_time;
+        if (h == &harts[aperiodic_hart])
+            list_add_tail(&job->list, &h->aperiodic_queue);
+        else
+            __post_job(&harts[aperiodic_hart], job);
+    }
+    __preempt_enable(self);
+    return seq;
+}
+
+// body of the server threads: run queued aperiodic jobs one after
+// another. with nothing queued, the polling server gives up the rest of
+// its budget until its next period and the background server steps
+// aside until the policy leaves the CPU idle again.
+void __server(void *arg)
+{
+    struct hart *h = myhart();
+    int polling = (int)(uint64)arg;
+    struct aperiodic_job *job = NULL;
+
+    while (1) {
+        struct thread *t = __preempt_disable();
+        if (job != NULL) {
+            __trace(THREAD_TRACE_APERIODIC, t->ID, h->threading_system_time,
+                    h->threading_system_time - job->submit_time, job->seq);
+            __free(job);
+            job = NULL;
+        }
+        if (list_empty(&h->aperiodic_queue)) {
+            __switch_out(t, polling ? SWITCH_FINISH : SWITCH_YIELD, NULL);
+            continue;
+        }
+        job = list_entry(h->aperiodic_queue.next, struct aperiodic_job, list);
+        list_del(&job->list);
+        __preempt_enable(t);
+
+        job->fp(job->arg);
+    }
+}
+
+struct thread *thread_create_polling_server(int budget, int period, int n)
+{
+    struct thread *t = thread_create(__server, (void *)1, 1, budget, period, n);
+    if (aperiodic_server == NULL)
+        aperiodic_server = t;
+    return t;
+}
+
+struct thread *thread_create_background_server(void)
+{
+    if (background_server != NULL)
+        return NULL;
+    background_server = thread_create(__server, (void *)0, 0, 1, -1, 1);
+    // it only runs in idle time of hart 0
+    background_server->hart = 0;
+    if (aperiodic_server == NULL)
+        aperiodic_server = background_server;
+    list_add_tail(&background_server->thread_list, &background_queue);
+    return background_server;
 }
 
 void thread_exit(void)
 {
-    if (current == &run_queue) {
+    struct hart *h = myhart();
+    if (h->current == &h->run_queue) {
         fprintf(2, "[FATAL] thread_exit is called on a nonexistent thread\n");
         exit(1);
     }
 
-    struct thread *to_remove = list_entry(current, struct thread, thread_list);
+    struct thread *to_remove = list_entry(h->current, struct thread, thread_list);
     int consume_ticks = cancelthrdstop(to_remove->thrdstop_context_id, 1);
-    threading_system_time += consume_ticks;
+    h->threading_system_time += consume_ticks;
 
     __release();
     __thread_exit(to_remove);
@@ -106,34 +1097,34 @@ void thread_exit(void)
 
 void __finish_current()
 {
-    struct thread *current_thread = list_entry(current, struct thread, thread_list);
+    struct hart *h = myhart();
+    struct thread *current_thread = list_entry(h->current, struct thread, thread_list);
     --current_thread->n;
 
-    printf("thread#%d finish at %d\n",
-           current_thread->ID, threading_system_time, current_thread->n);
+    __trace(THREAD_TRACE_FINISH, current_thread->ID, h->threading_system_time, 0, current_thread->n);
+    __stats_finish(current_thread);
 
     if (current_thread->n > 0) {
-        struct list_head *to_remove = current;
-        current = current->prev;
-        list_del(to_remove);
-        thread_add_at(current_thread, current_thread->current_deadline);
+        h->current = h->current->prev;
+        __dequeue(current_thread);
+        __next_job(current_thread, current_thread->current_deadline);
     } else {
         __thread_exit(current_thread);
     }
 }
 void __rt_finish_current()
 {
-    struct thread *current_thread = list_entry(current, struct thread, thread_list);
+    struct hart *h = myhart();
+    struct thread *current_thread = list_entry(h->current, struct thread, thread_list);
     --current_thread->n;
 
-    printf("thread#%d finish one cycle at %d: %d cycles left\n",
-           current_thread->ID, threading_system_time, current_thread->n);
+    __trace(THREAD_TRACE_RT_FINISH, current_thread->ID, h->threading_system_time, 0, current_thread->n);
+    __stats_finish(current_thread);
 
     if (current_thread->n > 0) {
-        struct list_head *to_remove = current;
-        current = current->prev;
-        list_del(to_remove);
-        thread_add_at(current_thread, current_thread->current_deadline);
+        h->current = h->current->prev;
+        __dequeue(current_thread);
+        __next_job(current_thread, current_thread->current_deadline);
     } else {
         __thread_exit(current_thread);
     }
@@ -141,66 +1132,70 @@ void __rt_finish_current()
 
 void switch_handler(void *arg)
 {
+    struct hart *h = myhart();
     uint64 elapsed_time = (uint64)arg;
-    struct thread *current_thread = list_entry(current, struct thread, thread_list);
+    struct thread *current_thread = list_entry(h->current, struct thread, thread_list);
 
-    threading_system_time += elapsed_time;
+    h->threading_system_time += elapsed_time;
      __release();
     current_thread->remaining_time -= elapsed_time;
 
-    if (current_thread->is_real_time)
-        if (threading_system_time > current_thread->current_deadline || 
-            (threading_system_time == current_thread->current_deadline && current_thread->remaining_time > 0)) {
-            printf("thread#%d misses a deadline at %d\n", current_thread->ID, threading_system_time);
-            exit(0);
-        }
-
-    if (current_thread->remaining_time <= 0) {
+    if (current_thread->is_real_time &&
+        (h->threading_system_time > current_thread->current_deadline ||
+         (h->threading_system_time == current_thread->current_deadline && current_thread->remaining_time > 0))) {
+        __trace(THREAD_TRACE_MISS, current_thread->ID, h->threading_system_time, 0, current_thread->n);
+        __overload(current_thread);
+    } else if (current_thread->remaining_time <= 0) {
         if (current_thread->is_real_time)
             __rt_finish_current();
         else
             __finish_current();
     } else {
         // move the current thread to the end of the run_queue
-        struct list_head *to_remove = current;
-        current = current->prev;
-        list_del(to_remove);
-        list_add_tail(to_remove, &run_queue);
+        h->current = h->current->prev;
+        ++current_thread->job_preemptions;
+        __requeue(current_thread);
     }
 
     __release();
     __schedule();
     __dispatch();
-    thrdresume(main_thrd_id);
+    thrdresume(h->main_thrd_id);
 }
 
 void __dispatch()
 {
-    if (current == &run_queue) {
+    struct hart *h = myhart();
+    if (h->current == &h->run_queue) {
         return;
     }
 
-    if (allocated_time < 0) {
+    if (h->allocated_time < 0) {
         fprintf(2, "[FATAL] allocated_time is negative\n");
         exit(1);
     }
 
-    struct thread *current_thread = list_entry(current, struct thread, thread_list);
-    if (current_thread->is_real_time && allocated_time == 0) { // miss deadline, abort
-        printf("thread#%d misses a deadline at %d\n", current_thread->ID, current_thread->current_deadline);
-        exit(0);
+    struct thread *current_thread = list_entry(h->current, struct thread, thread_list);
+    if (current_thread->is_real_time && h->allocated_time == 0) { // miss deadline, abort
+        __trace(THREAD_TRACE_MISS, current_thread->ID, current_thread->current_deadline, 0, current_thread->n);
+        __overload(current_thread);
+        __schedule();
+        __dispatch();
+        return;
     }
 
-    printf("dispatch thread#%d at %d: allocated_time=%d\n", current_thread->ID, threading_system_time, allocated_time);
+    __trace(THREAD_TRACE_DISPATCH, current_thread->ID, h->threading_system_time, h->allocated_time, current_thread->n);
+    if (current_thread->job_start < 0)
+        current_thread->job_start = h->threading_system_time;
 
     if (current_thread->buf_set) {
-        thrdstop(allocated_time, &(current_thread->thrdstop_context_id), switch_handler, (void *)allocated_time);
+        thrdstop(h->allocated_time, &(current_thread->thrdstop_context_id), switch_handler, (void *)h->allocated_time);
         thrdresume(current_thread->thrdstop_context_id);
     } else {
         current_thread->buf_set = 1;
         unsigned long new_stack_p = (unsigned long)current_thread->stack_p;
         current_thread->thrdstop_context_id = -1;
-        thrdstop(allocated_time, &(current_thread->thrdstop_context_id), switch_handler, (void *)allocated_time);
+        thrdstop(h->allocated_time, &(current_thread->thrdstop_context_id), switch_handler, (void *)h->allocated_time);
         if (current_thread->thrdstop_context_id < 0) {
             fprintf(2, "[ERROR] number of threads may exceed MAX_THRD_NUM\n");
             exit(1);
@@ -217,11 +1212,12 @@ void __dispatch()
 
 void __schedule()
 {
+    struct hart *h = myhart();
     struct threads_sched_args args = {
         .time_quantum = TIME_QUANTUM,
-        .current_time = threading_system_time,
-        .run_queue = &run_queue,
-        .release_queue = &release_queue,
+        .current_time = h->threading_system_time,
+        .run_queue = &h->run_queue,
+        .release_queue = &h->release_queue,
     };
 
     struct threads_sched_result r;
@@ -246,42 +1242,299 @@ void __schedule()
     r = schedule_dm(args);
 #endif
 
-    current = r.scheduled_thread_list_member;
-    allocated_time = r.allocated_time;
+#ifdef THREAD_SCHEDULER_MLFQ
+    r = schedule_mlfq(args);
+#endif
+
+#ifdef THREAD_SCHEDULER_CFS
+    r = schedule_cfs(args);
+#endif
+
+#ifdef THREAD_SCHEDULER_CBS
+    r = schedule_cbs(args);
+#endif
+
+#ifdef THREAD_SCHEDULER_CYCLIC
+    r = schedule_cyclic(args);
+#endif
+
+    // time the policy leaves idle goes to the background server
+    if (r.scheduled_thread_list_member == &h->run_queue && background_server != NULL
+        && h == &harts[0] && !list_empty(&h->aperiodic_queue)) {
+        r.scheduled_thread_list_member = &background_server->thread_list;
+        if (r.allocated_time <= 0)
+            r.allocated_time = TIME_QUANTUM;
+        // it has no processing time of its own to run out of
+        background_server->remaining_time = r.allocated_time + 1;
+    }
+
+    h->current = r.scheduled_thread_list_member;
+    h->allocated_time = r.allocated_time;
 }
 
 void back_to_main_handler(void *arg)
 {
-    sleeping = 0;
-    threading_system_time += (uint64)arg;
-    thrdresume(main_thrd_id);
+    struct hart *h = myhart();
+    h->sleeping = 0;
+    h->threading_system_time += (uint64)arg;
+    thrdresume(h->main_thrd_id);
 }
 
-void thread_start_threading()
+// the scheduler loop of the calling hart, until it has nothing left to run
+void __run_hart(void)
 {
-    threading_system_time = 0;
-    current = &run_queue;
+    struct hart *h = myhart();
+    h->threading_system_time = 0;
+    h->current = &h->run_queue;
 
     // call thrdstop just for obtain an ID
-    thrdstop(1000, &main_thrd_id, back_to_main_handler, (void *)0);
-    cancelthrdstop(main_thrd_id, 0);
+    thrdstop(1000, &h->main_thrd_id, back_to_main_handler, (void *)0);
+    cancelthrdstop(h->main_thrd_id, 0);
 
-    while (!list_empty(&run_queue) || !list_empty(&release_queue)) {
+    while (__has_work()) {
+        __reap();
         __release();
         __schedule();
-        cancelthrdstop(main_thrd_id, 0);
+        cancelthrdstop(h->main_thrd_id, 0);
         __dispatch();
 
-        if (list_empty(&run_queue) && list_empty(&release_queue)) {
+        if (!__has_work()) {
             break;
         }
 
         // no thread in run_queue, release_queue not empty
-        printf("run_queue is empty, sleep for %d ticks\n", allocated_time);
-        sleeping = 1;
-        thrdstop(allocated_time, &main_thrd_id, back_to_main_handler, (void *)allocated_time);
-        while (sleeping) {
-            // zzz...
+        __trace(THREAD_TRACE_SLEEP, 0, h->threading_system_time, h->allocated_time, 0);
+        h->sleeping = 1;
+        thrdstop(h->allocated_time, &h->main_thrd_id, back_to_main_handler, (void *)h->allocated_time);
+        while (h->sleeping) {
+            // zzz... block in the kernel until the thrdstop timer fires,
+            // back_to_main_handler() then clears `sleeping`
+            thrdsleep();
+        }
+    }
+
+    __reap();
+    if (h->nr_blocked > 0)
+        fprintf(2, "[WARN] %d threads are still blocked when threading ends\n", h->nr_blocked);
+}
+
+void thread_start_threading()
+{
+#ifdef THREAD_SCHEDULER_CYCLIC
+    struct hart *h = myhart();
+    struct threads_sched_args args = {
+        .time_quantum = TIME_QUANTUM,
+        .current_time = 0,
+        .run_queue = &h->run_queue,
+        .release_queue = &h->release_queue,
+    };
+    if (schedule_cyclic_build(args) < 0) {
+        fprintf(2, "[FATAL] no cyclic schedule for this task set\n");
+        exit(1);
+    }
+#endif
+
+    __run_hart();
+    __trace_flush();
+}
+
+void thread_set_hart(struct thread *t, int hart)
+{
+    t->hart = hart;
+}
+
+// 1 if the real-time threads assigned to hart `k` among `ts` pass the
+// schedulability test of the policy
+int __hart_schedulable(struct thread **ts, int nt, int k)
+{
+    int i;
+#ifdef THREAD_SCHEDULER_DM
+    // response-time analysis with deadline-monotonic priorities
+    for (i = 0; i < nt; i++) {
+        struct thread *a = ts[i];
+        if (a->hart != k || !a->is_real_time)
+            continue;
+        int r = a->processing_time, next;
+        while (1) {
+            next = a->processing_time;
+            for (int j = 0; j < nt; j++) {
+                struct thread *b = ts[j];
+                if (j == i || b->hart != k || !b->is_real_time)
+                    continue;
+                if (b->deadline < a->deadline || (b->deadline == a->deadline && b->ID < a->ID))
+                    next += (r + b->period - 1) / b->period * b->processing_time;
+            }
+            if (next > a->deadline)
+                return 0;
+            if (next == r)
+                break;
+            r = next;
+        }
+    }
+    return 1;
+#else
+    // deadline-driven policies: total density at most 1, in millionths
+    // rounded up so that rounding never admits an overloaded hart
+    int density = 0;
+    for (i = 0; i < nt; i++) {
+        struct thread *a = ts[i];
+        if (a->hart == k && a->is_real_time)
+            density += ((uint64)a->processing_time * 1000000 + a->deadline - 1) / a->deadline;
+    }
+    return density <= 1000000;
+#endif
+}
+
+// placement order of __partition(): pinned threads, then real-time
+// threads by decreasing utilization, then the others
+int __place_before(struct thread *a, struct thread *b)
+{
+    if ((a->hart >= 0) != (b->hart >= 0))
+        return a->hart >= 0;
+    if (a->is_real_time != b->is_real_time)
+        return a->is_real_time;
+    return a->is_real_time && (uint64)a->processing_time * b->period > (uint64)b->processing_time * a->period;
+}
+
+// assign the threads ts[0, nt) to harts
+// [0, n): real-time threads first-fit, by decreasing utilization, to the
+// first hart that stays schedulable, the others to the hart with the
+// fewest threads. threads placed with thread_set_hart() stay there.
+// returns -1 if some real-time thread fits on no hart.
+int __place(struct thread **ts, int nt, int n)
+{
+    struct thread *t;
+    int i, j, k, count[THREAD_MAX_HARTS];
+
+    for (i = 1; i < nt; i++) {
+        t = ts[i];
+        for (j = i; j > 0 && __place_before(t, ts[j - 1]); j--)
+            ts[j] = ts[j - 1];
+        ts[j] = t;
+    }
+
+    for (k = 0; k < n; k++)
+        count[k] = 0;
+    for (i = 0; i < nt; i++) {
+        t = ts[i];
+        if (t->hart >= n) {
+            fprintf(2, "[ERROR] thread#%d is placed on hart %d of %d\n", t->ID, t->hart, n);
+            return -1;
+        }
+        if (t->hart < 0 && t->is_real_time) {
+            for (k = 0; k < n; k++) {
+                t->hart = k;
+                if (__hart_schedulable(ts, nt, k))
+                    break;
+                t->hart = -1;
+            }
+            if (t->hart < 0) {
+                fprintf(2, "[ERROR] thread#%d fits on none of %d harts\n", t->ID, n);
+                return -1;
+            }
+        } else if (t->hart < 0) {
+            t->hart = 0;
+            for (k = 1; k < n; k++) {
+                if (count[k] < count[t->hart])
+                    t->hart = k;
+            }
+        }
+        ++count[t->hart];
+    }
+    for (k = 0; k < n; k++) {
+        if (!__hart_schedulable(ts, nt, k)) {
+            fprintf(2, "[ERROR] the threads placed on hart %d are not schedulable\n", k);
+            return -1;
         }
     }
+    return 0;
+}
+
+// place the threads waiting for their first release on hart 0 and move
+// them to their harts' queues
+int __partition(int n)
+{
+    struct hart *h = &harts[0];
+    struct release_queue_entry *e, *ne;
+    struct thread *t, *tmp, **ts;
+    int nt = 0, ret;
+
+    list_for_each_entry(e, &h->release_queue, thread_list)
+        ++nt;
+    list_for_each_entry(t, &h->sporadic_idle, thread_list)
+        ++nt;
+    ts = (struct thread **)__malloc(sizeof(struct thread *) * (nt > 0 ? nt : 1));
+    if (ts == NULL) {
+        fprintf(2, "[ERROR] out of memory placing %d threads\n", nt);
+        return -1;
+    }
+    nt = 0;
+    list_for_each_entry(e, &h->release_queue, thread_list)
+        ts[nt++] = e->thrd;
+    list_for_each_entry(t, &h->sporadic_idle, thread_list)
+        ts[nt++] = t;
+    ret = __place(ts, nt, n);
+    __free(ts);
+    if (ret < 0)
+        return -1;
+
+    list_for_each_entry_safe(e, ne, &h->release_queue, thread_list) {
+        if (e->thrd->hart != 0)
+            list_move_tail(&e->thread_list, &__hart(e->thrd->hart)->release_queue);
+    }
+    list_for_each_entry_safe(t, tmp, &h->sporadic_idle, thread_list) {
+        if (t->hart != 0)
+            list_move_tail(&t->thread_list, &__hart(t->hart)->sporadic_idle);
+    }
+    if (aperiodic_server != NULL && aperiodic_server->hart > 0) {
+        aperiodic_hart = aperiodic_server->hart;
+        list_splice_init(&h->aperiodic_queue, __hart(aperiodic_hart)->aperiodic_queue.prev);
+    }
+    return 0;
+}
+
+void __hart_main(void *arg)
+{
+    __run_hart();
+    exit(0);
+}
+
+int thread_start_threading_partitioned(int n)
+{
+#if defined(THREAD_SCHEDULER_MLFQ) || defined(THREAD_SCHEDULER_CFS) || \
+    defined(THREAD_SCHEDULER_CBS) || defined(THREAD_SCHEDULER_CYCLIC)
+    fprintf(2, "[ERROR] this policy keeps state of its own and can not run on several harts\n");
+    return -1;
+#else
+    int i;
+
+    if (n < 1 || n > THREAD_MAX_HARTS || myhart() != &harts[0]) {
+        fprintf(2, "[ERROR] can not start threading on %d harts\n", n);
+        return -1;
+    }
+    for (i = 0; i < n; i++)
+        __hart(i);
+    if (__partition(n) < 0)
+        return -1;
+
+    // clone() shares memory as it is now, and sbrk() fails while it is
+    // shared: grow the heap up front for the releases to come
+    free(malloc(THREAD_HART_HEAP));
+    harts[0].pid = getpid();
+    nharts = n;
+    for (i = 1; i < n; i++) {
+        char *stack = __malloc(THREAD_HART_STACK);
+        if (stack == NULL || (harts[i].pid = clone(__hart_main, NULL, stack + THREAD_HART_STACK, i)) < 0) {
+            fprintf(2, "[FATAL] can not start hart %d\n", i);
+            exit(1);
+        }
+    }
+
+    __run_hart();
+    for (i = 1; i < n; i++)
+        wait(0);
+    nharts = 1;
+    __trace_flush();
+    return 0;
+#endif
 }
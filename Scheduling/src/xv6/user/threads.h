@@ -2,6 +2,7 @@
 #define THREADS_H_
 
 #include "user/list.h"
+#include "user/rbtree.h"
 #include "kernel/types.h"
 
 struct thread {
@@ -34,8 +35,69 @@ struct thread {
     int remaining_time;
     // the deadline of the current period
     int current_deadline;
+    // MLFQ priority level, 0 is the highest
+    int mlfq_level;
+    // a full MLFQ quantum given at the last dispatch, 0 if the slice was cut short
+    int mlfq_allocated;
+    // remaining_time when that quantum was given
+    int mlfq_dispatch_remaining;
+    // CFS virtual runtime, ticks scaled by CFS_NICE_0_WEIGHT / weight
+    uint64 vruntime;
+    // node in the CFS timeline, ordered by vruntime
+    struct rb_node cfs_node;
+    // remaining_time when the thread was last dispatched by CFS
+    int cfs_dispatch_remaining;
+    // what completing one job is worth, for THREAD_OVERLOAD_ABORT
+    int value;
+    // deadlines missed by this thread's jobs
+    int misses;
+    // jobs given up without completing, missed or aborted
+    int dropped;
+    // 1 while the thread waits in a wait queue instead of the run queue
+    int blocked;
+    // deadline and current_deadline inherited from the most urgent
+    // thread waiting for an rt_mutex this thread holds, 0 if none
+    int pi_deadline;
+    int pi_current_deadline;
+    // the rt_mutexes held by this thread
+    struct list_head pi_held;
+    // the rt_mutex this thread is blocked on, NULL if none
+    struct thread_rt_mutex *pi_blocked_on;
+    // 1 if jobs are released by thread_release_now() rather than every
+    // period, which is then the minimum inter-arrival time
+    int sporadic;
+    // 1 while a sporadic thread waits for its next release
+    int parked;
+    // release and first dispatch time of the current job, -1 if not
+    // dispatched yet, and how often it has been preempted
+    int job_release;
+    int job_start;
+    int job_preemptions;
+    // the hart the thread runs on, -1 until threading starts on several
+    // harts or thread_set_hart() is called
+    int hart;
+    // 1 while a release posted by another hart is in this thread's
+    // hart's inbox, and the next thread there
+    int release_posted;
+    struct thread *inbox_next;
 };
 
+// the relative deadline deadline-monotonic policies should rank `t` by
+static inline int thread_sched_deadline(struct thread *t)
+{
+    if (t->pi_deadline > 0 && t->pi_deadline < t->deadline)
+        return t->pi_deadline;
+    return t->deadline;
+}
+
+// the absolute deadline EDF and least-slack policies should rank `t` by
+static inline int thread_sched_current_deadline(struct thread *t)
+{
+    if (t->pi_current_deadline > 0 && t->pi_current_deadline < t->current_deadline)
+        return t->pi_current_deadline;
+    return t->current_deadline;
+}
+
 struct release_queue_entry {
     struct thread *thrd;
     // for linked list
@@ -44,10 +106,180 @@ struct release_queue_entry {
     int release_time;
 };
 
+// a mutex that puts contending threads to sleep; unlock hands the
+// mutex to the first waiter
+struct thread_mutex {
+    struct thread *owner;
+    struct list_head waiters;
+};
+
+// a counting semaphore that puts threads to sleep while it is zero
+struct thread_sem {
+    int count;
+    struct list_head waiters;
+};
+
+// a mutex with priority inheritance for real-time threads: while a more
+// urgent thread waits for it, the owner is ranked by the waiter's
+// deadline, through thread_sched_deadline() and
+// thread_sched_current_deadline(), so a less urgent thread can not
+// hold it up indefinitely. unlock hands the mutex to the most urgent
+// waiter.
+struct thread_rt_mutex {
+    struct thread *owner;
+    struct list_head waiters;
+    // in the owner's pi_held list
+    struct list_head held_node;
+};
+
+// event types recorded in the scheduling trace
+#define THREAD_TRACE_DISPATCH  1
+#define THREAD_TRACE_FINISH    2
+#define THREAD_TRACE_RT_FINISH 3
+#define THREAD_TRACE_SLEEP     4
+#define THREAD_TRACE_MISS      5
+#define THREAD_TRACE_RELEASE   6
+#define THREAD_TRACE_DROP      7
+#define THREAD_TRACE_APERIODIC 8
+
+#ifndef THREAD_TRACE_SIZE
+#define THREAD_TRACE_SIZE 1024
+#endif
+
+#define THREAD_TRACE_MAGIC 0x54524354 // "TCRT"
+
+struct thread_trace_event {
+    // one of THREAD_TRACE_*
+    int type;
+    // ID of the thread, 0 for the main thread (sleep events)
+    int ID;
+    // the threading time when the event happened, measured in ticks
+    int time;
+    // ticks given to the thread (dispatch, sleep) or to the job until its
+    // deadline (release), or the response time of an aperiodic job
+    int allocated_time;
+    // the number of releases left after a finish event, or the sequence
+    // number of an aperiodic job
+    int n;
+    // the hart that recorded the event, whose clock `time` is on; 0
+    // unless thread_start_threading_partitioned() runs several
+    int hart;
+};
+
+// header of the binary trace written by thread_trace_dump()
+struct thread_trace_header {
+    int magic;
+    int size;
+    // number of events in the trace, oldest first
+    int count;
+    // number of events overwritten because the ring was full
+    int dropped;
+};
+
+// what the runtime does when a real-time job misses its deadline
+// end the process, as the grading scripts expect
+#define THREAD_OVERLOAD_EXIT    0
+// give up the late job and wait for the thread's next release
+#define THREAD_OVERLOAD_SKIP    1
+// skip, and also abort the lowest-value ready job if it is worth less
+#define THREAD_OVERLOAD_ABORT   2
+// skip, and double the thread's period and deadline
+#define THREAD_OVERLOAD_DEGRADE 3
+
+// log-scale histogram: bucket 0 counts values <= 0, bucket i > 0 counts
+// values in [2^(i-1), 2^i - 1], the last bucket everything above
+#define THREAD_HIST_BUCKETS 16
+
+struct thread_hist {
+    int count;
+    int sum;
+    int max;
+    int bucket[THREAD_HIST_BUCKETS];
+};
+
+// harts thread_start_threading_partitioned() can run on
+#ifndef THREAD_MAX_HARTS
+#define THREAD_MAX_HARTS 8
+#endif
+
+#ifndef THREAD_STATS_MAX
+#define THREAD_STATS_MAX 64
+#endif
+
+// per-thread job statistics, kept after the thread exits; threads with
+// an ID of THREAD_STATS_MAX or more are not recorded
+struct thread_stats {
+    int ID;
+    int is_real_time;
+    // completed jobs
+    int jobs;
+    int misses;
+    int dropped;
+    // finish - release, in ticks
+    struct thread_hist response;
+    // first dispatch - release, in ticks
+    struct thread_hist waiting;
+    // deadline - finish, real-time threads only; jobs that miss their
+    // deadline are counted in `misses` and not finished, so it is >= 0
+    struct thread_hist slack;
+    struct thread_hist preemptions;
+};
+
 struct thread *thread_create(void (*f)(void *), void *arg, int is_real_time, int processing_time, int period, int n);
 void thread_set_weight(struct thread *t, int weight);
+void thread_set_value(struct thread *t, int value);
+void thread_set_overload(int policy);
+// budget and period of the server that runs non-real-time threads
+// under THREAD_SCHEDULER_CBS
+void thread_set_server(int budget, int period);
 void thread_add_at(struct thread *t, int arrival_time);
 void thread_exit(void);
+// end the running thread's current job before its processing time is used up
+void thread_finish_job(void);
+// sporadic threads are released by thread_release_now() instead of at
+// every period, and no sooner than one period after the previous release;
+// returns -1 if the previous job is still pending
+void thread_set_sporadic(struct thread *t);
+int thread_release_now(struct thread *t);
+// queue an aperiodic job for the server threads, returns its sequence number
+int thread_submit(void (*f)(void *), void *arg);
+// a real-time thread running queued aperiodic jobs for up to `budget`
+// ticks every `period`, for `n` periods; add it with thread_add_at()
+struct thread *thread_create_polling_server(int budget, int period, int n);
+// a thread running queued aperiodic jobs whenever the policy would idle;
+// it is not added to the run queue
+struct thread *thread_create_background_server(void);
+// take the running thread off the run queue until thread_wakeup() is
+// called on `wait_queue`; the caller re-checks what it waited for
+void thread_block(struct list_head *wait_queue);
+// make every thread blocked on `wait_queue` runnable, returns how many
+int thread_wakeup(struct list_head *wait_queue);
+void thread_mutex_init(struct thread_mutex *m);
+void thread_mutex_lock(struct thread_mutex *m);
+void thread_mutex_unlock(struct thread_mutex *m);
+void thread_sem_init(struct thread_sem *s, int count);
+void thread_sem_down(struct thread_sem *s);
+void thread_sem_up(struct thread_sem *s);
+void thread_rt_mutex_init(struct thread_rt_mutex *m);
+void thread_rt_mutex_lock(struct thread_rt_mutex *m);
+void thread_rt_mutex_unlock(struct thread_rt_mutex *m);
 void thread_start_threading();
+// run the threads on `n` harts, one kernel thread from clone() each,
+// with a run queue and a thrdstop timer per hart. threads are assigned
+// to harts by first-fit decreasing utilization and stay there, so every
+// hart passes the policy's test (response-time analysis for DM, density
+// for the others). wait queues, mutexes and semaphores are hart-local:
+// pin threads sharing one to the same hart with thread_set_hart().
+// thread_release_now() and thread_submit() work from any hart.
+// returns -1, before running anything, if the threads do not fit or
+// the policy keeps global state (MLFQ, CFS, CBS, cyclic).
+int thread_start_threading_partitioned(int n);
+void thread_set_hart(struct thread *t, int hart);
+void thread_trace_file(char *path);
+// statistics of thread `id`, NULL if it has none
+struct thread_stats *thread_stats(int id);
+// print per-thread percentiles of the histograms
+void thread_sched_report(void);
+int thread_trace_dump(int fd);
 
 #endif // THREADS_H_
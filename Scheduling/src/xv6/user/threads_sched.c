@@ -53,6 +53,8 @@ struct threads_sched_result schedule_lst(struct threads_sched_args args)
 {
     struct threads_sched_result r;
     // TODO: implement the least-slack-time scheduling algorithm
+    // rank threads by thread_sched_current_deadline() rather than
+    // current_deadline, so rt_mutex priority inheritance takes effect
 
     return r;
 }
@@ -62,6 +64,470 @@ struct threads_sched_result schedule_dm(struct threads_sched_args args)
 {
     struct threads_sched_result r;
     // TODO: implement the deadline-monotonic scheduling algorithm
+    // rank threads by thread_sched_deadline() rather than deadline,
+    // so rt_mutex priority inheritance takes effect
 
     return r;
 }
+
+/* idle until the earliest release when the run queue is empty */
+static struct threads_sched_result sleep_until_release(struct threads_sched_args args)
+{
+    struct threads_sched_result r;
+    struct release_queue_entry *e;
+    int earliest = -1;
+
+    list_for_each_entry(e, args.release_queue, thread_list) {
+        if (earliest < 0 || e->release_time < earliest)
+            earliest = e->release_time;
+    }
+    r.scheduled_thread_list_member = args.run_queue;
+    r.allocated_time = earliest > args.current_time ? earliest - args.current_time : 1;
+    return r;
+}
+
+/* Multilevel Feedback Queue Scheduling */
+#define MLFQ_LEVELS 4
+// every thread goes back to the top level once per this many quanta
+#define MLFQ_BOOST_QUANTA 16
+
+struct threads_sched_result schedule_mlfq(struct threads_sched_args args)
+{
+    static int last_boost = 0;
+    struct threads_sched_result r;
+    struct thread *th, *chosen = NULL;
+    struct release_queue_entry *e;
+
+    if (list_empty(args.run_queue))
+        return sleep_until_release(args);
+
+    // periodic priority boost, so demoted threads cannot starve
+    int boost = args.current_time - last_boost >= MLFQ_BOOST_QUANTA * args.time_quantum;
+    if (boost)
+        last_boost = args.current_time;
+
+    list_for_each_entry(th, args.run_queue, thread_list) {
+        // a thread that ran for its whole quantum without finishing is demoted
+        if (th->mlfq_allocated > 0 && th->remaining_time <= th->mlfq_dispatch_remaining - th->mlfq_allocated
+            && th->mlfq_level < MLFQ_LEVELS - 1)
+            ++th->mlfq_level;
+        th->mlfq_allocated = 0;
+        if (boost)
+            th->mlfq_level = 0;
+
+        // the run queue is in round-robin order within each level
+        if (chosen == NULL || th->mlfq_level < chosen->mlfq_level)
+            chosen = th;
+    }
+
+    int quantum = args.time_quantum << chosen->mlfq_level;
+    r.scheduled_thread_list_member = &chosen->thread_list;
+    r.allocated_time = chosen->remaining_time < quantum ? chosen->remaining_time : quantum;
+
+    // new threads and new jobs of periodic threads enter at the top level
+    // and preempt lower levels
+    if (chosen->mlfq_level > 0) {
+        list_for_each_entry(e, args.release_queue, thread_list) {
+            if (e->release_time > args.current_time && e->release_time < args.current_time + r.allocated_time)
+                r.allocated_time = e->release_time - args.current_time;
+        }
+    }
+
+    if (r.allocated_time == quantum) {
+        chosen->mlfq_allocated = quantum;
+        chosen->mlfq_dispatch_remaining = chosen->remaining_time;
+    }
+    return r;
+}
+
+/* Weighted Fair-Share (CFS-style virtual runtime) Scheduling */
+// a weight-1 thread's virtual runtime advances this much per tick
+#define CFS_NICE_0_WEIGHT 1024
+// every runnable thread runs once per this many quanta...
+#define CFS_LATENCY_QUANTA 8
+// ...unless that would make slices shorter than this many ticks
+#define CFS_MIN_GRANULARITY 1
+
+static struct rb_root cfs_timeline = RB_ROOT;
+static uint64 cfs_min_vruntime = 0;
+static int cfs_nr_running = 0;
+static int cfs_total_weight = 0;
+// the thread dispatched by the last decision, until its time is accounted
+static struct thread *cfs_curr = NULL;
+
+static void cfs_insert(struct thread *t)
+{
+    struct rb_node **link = &cfs_timeline.rb_node, *parent = NULL;
+    while (*link) {
+        struct thread *th = rb_entry(*link, struct thread, cfs_node);
+        parent = *link;
+        if (t->vruntime < th->vruntime || (t->vruntime == th->vruntime && t->ID < th->ID))
+            link = &parent->rb_left;
+        else
+            link = &parent->rb_right;
+    }
+    rb_link_node(&t->cfs_node, parent, link);
+    rb_insert_color(&t->cfs_node, &cfs_timeline);
+}
+
+// charge the last dispatched thread for the ticks it consumed
+static void cfs_update_curr(void)
+{
+    struct thread *t = cfs_curr;
+    if (t == NULL)
+        return;
+    cfs_curr = NULL;
+
+    int consumed = t->cfs_dispatch_remaining - t->remaining_time;
+    if (consumed <= 0)
+        return;
+    rb_erase(&t->cfs_node, &cfs_timeline);
+    t->vruntime += (uint64)consumed * CFS_NICE_0_WEIGHT / t->weight;
+    cfs_insert(t);
+
+    struct thread *leftmost = rb_entry(rb_first(&cfs_timeline), struct thread, cfs_node);
+    if (leftmost->vruntime > cfs_min_vruntime)
+        cfs_min_vruntime = leftmost->vruntime;
+}
+
+void schedule_cfs_enqueue(struct thread *t)
+{
+    // a thread that arrives late or was away starts level with the others
+    // instead of monopolizing the CPU to catch up
+    if (t->vruntime < cfs_min_vruntime)
+        t->vruntime = cfs_min_vruntime;
+    cfs_insert(t);
+    ++cfs_nr_running;
+    cfs_total_weight += t->weight;
+}
+
+void schedule_cfs_dequeue(struct thread *t)
+{
+    if (t == cfs_curr)
+        cfs_update_curr();
+    rb_erase(&t->cfs_node, &cfs_timeline);
+    --cfs_nr_running;
+    cfs_total_weight -= t->weight;
+}
+
+struct threads_sched_result schedule_cfs(struct threads_sched_args args)
+{
+    struct threads_sched_result r;
+    struct release_queue_entry *e;
+
+    if (list_empty(args.run_queue))
+        return sleep_until_release(args);
+
+    cfs_update_curr();
+
+    // the thread with the smallest virtual runtime is the most underserved
+    struct thread *t = rb_entry(rb_first(&cfs_timeline), struct thread, cfs_node);
+
+    // split a bounded period among the runnable threads in proportion to weight
+    int period = CFS_LATENCY_QUANTA * args.time_quantum;
+    if (cfs_nr_running * CFS_MIN_GRANULARITY > period)
+        period = cfs_nr_running * CFS_MIN_GRANULARITY;
+    int slice = period * t->weight / cfs_total_weight;
+    if (slice < CFS_MIN_GRANULARITY)
+        slice = CFS_MIN_GRANULARITY;
+
+    r.scheduled_thread_list_member = &t->thread_list;
+    r.allocated_time = t->remaining_time < slice ? t->remaining_time : slice;
+
+    // let a new arrival compete as soon as it is released
+    list_for_each_entry(e, args.release_queue, thread_list) {
+        if (e->release_time > args.current_time && e->release_time < args.current_time + r.allocated_time)
+            r.allocated_time = e->release_time - args.current_time;
+    }
+
+    cfs_curr = t;
+    t->cfs_dispatch_remaining = t->remaining_time;
+    return r;
+}
+
+/* Constant-Bandwidth Server Scheduling */
+// real-time threads are scheduled by EDF; best-effort threads share a
+// server that gets at most CBS_BUDGET ticks every CBS_PERIOD ticks and
+// competes under EDF with the server deadline, so the real-time threads
+// keep their guarantees as long as their utilization plus budget/period
+// stays at or below 1. With no real-time work ready, best-effort threads
+// run in the background without using up the budget.
+#define CBS_BUDGET 2
+#define CBS_PERIOD 10
+
+static int cbs_max_budget = CBS_BUDGET;
+static int cbs_period = CBS_PERIOD;
+static int cbs_budget = CBS_BUDGET;
+static int cbs_deadline = 0;
+// the server had best-effort work at the last decision
+static int cbs_active = 0;
+// the last dispatch ran a best-effort thread, starting at cbs_dispatch_time
+static int cbs_ran = 0;
+static int cbs_dispatch_time = 0;
+
+void schedule_cbs_set_server(int budget, int period)
+{
+    cbs_max_budget = budget;
+    cbs_period = period;
+    cbs_budget = budget;
+    cbs_deadline = 0;
+}
+
+struct threads_sched_result schedule_cbs(struct threads_sched_args args)
+{
+    struct threads_sched_result r;
+    struct thread *th, *rt = NULL, *be = NULL;
+    struct release_queue_entry *e;
+
+    // charge the server for the slice that just ended
+    if (cbs_ran) {
+        cbs_budget -= args.current_time - cbs_dispatch_time;
+        cbs_ran = 0;
+    }
+    // exhausted: replenish and postpone the deadline by one period
+    if (cbs_budget <= 0) {
+        cbs_budget = cbs_max_budget;
+        cbs_deadline += cbs_period;
+    }
+
+    if (list_empty(args.run_queue)) {
+        cbs_active = 0;
+        return sleep_until_release(args);
+    }
+
+    list_for_each_entry(th, args.run_queue, thread_list) {
+        if (th->is_real_time) {
+            if (rt == NULL || thread_sched_current_deadline(th) < thread_sched_current_deadline(rt)
+                || (thread_sched_current_deadline(th) == thread_sched_current_deadline(rt) && th->ID < rt->ID))
+                rt = th;
+        } else if (be == NULL) {
+            // best-effort threads take turns in run queue order
+            be = th;
+        }
+    }
+
+    // the server wakes up: keep its deadline only if the remaining budget
+    // would not exceed its bandwidth until then
+    if (be != NULL && !cbs_active) {
+        if (cbs_deadline <= args.current_time
+            || cbs_budget * cbs_period >= (cbs_deadline - args.current_time) * cbs_max_budget) {
+            cbs_deadline = args.current_time + cbs_period;
+            cbs_budget = cbs_max_budget;
+        }
+    }
+    cbs_active = be != NULL;
+
+    if (be != NULL && (rt == NULL || cbs_deadline < thread_sched_current_deadline(rt))) {
+        int quantum = be->weight * args.time_quantum;
+        r.scheduled_thread_list_member = &be->thread_list;
+        r.allocated_time = be->remaining_time < quantum ? be->remaining_time : quantum;
+        // idle time, when no real-time thread is ready, is not charged
+        if (rt != NULL) {
+            if (r.allocated_time > cbs_budget)
+                r.allocated_time = cbs_budget;
+            cbs_ran = 1;
+            cbs_dispatch_time = args.current_time;
+        }
+    } else {
+        r.scheduled_thread_list_member = &rt->thread_list;
+        r.allocated_time = rt->remaining_time;
+        if (rt->current_deadline - args.current_time < r.allocated_time)
+            r.allocated_time = rt->current_deadline - args.current_time;
+    }
+
+    // a job released meanwhile may have an earlier deadline
+    list_for_each_entry(e, args.release_queue, thread_list) {
+        if (e->release_time > args.current_time && e->release_time < args.current_time + r.allocated_time)
+            r.allocated_time = e->release_time - args.current_time;
+    }
+    return r;
+}
+
+/* Cyclic Executive Scheduling */
+// The whole schedule of a periodic task set is computed once, by an
+// offline EDF run, into a table of (thread, ticks) entries; dispatching
+// is then a table lookup. When all threads are released together the
+// table covers one hyperperiod and repeats, otherwise it covers every
+// job of the run.
+#define CYCLIC_MAX_HYPERPERIOD 100000
+#define CYCLIC_MAX_THREADS 64
+
+struct cyclic_entry {
+    // index into cyclic_threads, -1 for idle
+    int slot;
+    int ticks;
+};
+
+static struct thread *cyclic_threads[CYCLIC_MAX_THREADS];
+static int cyclic_nthreads = 0;
+static struct cyclic_entry *cyclic_table = NULL;
+static int cyclic_len = 0;
+static int cyclic_next = 0;
+// the table wraps around to this entry, -1 if it does not repeat
+static int cyclic_loop = -1;
+
+static int gcd(int a, int b)
+{
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Run EDF from time 0 to `end`, with threads released at offset[i] +
+// k * period and at most `jobs[i]` times. Stores entries in `table` if
+// it is not NULL, and returns the number of entries, or -1 if a
+// deadline would be missed. `loop_at` is the time at which `*loop`
+// records the entry index.
+static int cyclic_run_edf(int end, int *offset, int *jobs, int loop_at, int *loop,
+                          struct cyclic_entry *table)
+{
+    int released[CYCLIC_MAX_THREADS], left[CYCLIC_MAX_THREADS], deadline[CYCLIC_MAX_THREADS];
+    int now = 0, len = 0, last_slot = -2, last_job = -1;
+    int i;
+
+    for (i = 0; i < cyclic_nthreads; i++) {
+        released[i] = 0;
+        left[i] = 0;
+    }
+    *loop = -1;
+
+    while (now < end) {
+        // release jobs and find the next release after now
+        int next = end, pick = -1;
+        for (i = 0; i < cyclic_nthreads; i++) {
+            struct thread *t = cyclic_threads[i];
+            int r = offset[i] + released[i] * t->period;
+            if (released[i] < jobs[i] && r <= now) {
+                if (left[i] > 0)
+                    return -1;
+                left[i] = t->processing_time;
+                deadline[i] = r + t->deadline;
+                ++released[i];
+                r += t->period;
+            }
+            if (released[i] < jobs[i] && r < next)
+                next = r;
+        }
+        for (i = 0; i < cyclic_nthreads; i++) {
+            if (left[i] > 0 && (pick < 0 || deadline[i] < deadline[pick]
+                                || (deadline[i] == deadline[pick] && cyclic_threads[i]->ID < cyclic_threads[pick]->ID)))
+                pick = i;
+        }
+
+        if (now == loop_at) {
+            *loop = len;
+            last_slot = -2;
+        }
+
+        int run = next - now;
+        if (pick >= 0 && left[pick] < run)
+            run = left[pick];
+        if (pick >= 0 && now + run > deadline[pick])
+            return -1;
+
+        // a job that keeps running across a release stays one entry
+        int job = pick >= 0 ? released[pick] : -1;
+        if (pick == last_slot && job == last_job) {
+            if (table)
+                table[len - 1].ticks += run;
+        } else {
+            if (table) {
+                table[len].slot = pick;
+                table[len].ticks = run;
+            }
+            ++len;
+        }
+        last_slot = pick;
+        last_job = job;
+        if (pick >= 0)
+            left[pick] -= run;
+        now += run;
+    }
+    return len;
+}
+
+int schedule_cyclic_build(struct threads_sched_args args)
+{
+    int offset[CYCLIC_MAX_THREADS], jobs[CYCLIC_MAX_THREADS];
+    struct release_queue_entry *e;
+    int hyperperiod = 1, synchronous = 1, end = 0, loop_at = -1, loop, i;
+
+    cyclic_nthreads = 0;
+    list_for_each_entry(e, args.release_queue, thread_list) {
+        struct thread *t = e->thrd;
+        if (!t->is_real_time || t->period <= 0 || cyclic_nthreads == CYCLIC_MAX_THREADS)
+            return -1;
+        offset[cyclic_nthreads] = e->release_time;
+        jobs[cyclic_nthreads] = t->n;
+        cyclic_threads[cyclic_nthreads++] = t;
+        if (e->release_time != offset[0])
+            synchronous = 0;
+        hyperperiod = hyperperiod / gcd(hyperperiod, t->period) * t->period;
+        if (hyperperiod > CYCLIC_MAX_HYPERPERIOD)
+            return -1;
+    }
+    if (cyclic_nthreads == 0)
+        return -1;
+
+    if (synchronous) {
+        // every hyperperiod after the common release looks the same
+        end = offset[0] + hyperperiod;
+        loop_at = offset[0];
+        for (i = 0; i < cyclic_nthreads; i++)
+            jobs[i] = hyperperiod / cyclic_threads[i]->period;
+    } else {
+        for (i = 0; i < cyclic_nthreads; i++) {
+            int last = offset[i] + jobs[i] * cyclic_threads[i]->period;
+            if (last > end)
+                end = last;
+        }
+    }
+
+    int len = cyclic_run_edf(end, offset, jobs, loop_at, &loop, NULL);
+    if (len <= 0)
+        return -1;
+    if (cyclic_table)
+        free(cyclic_table);
+    cyclic_table = malloc(len * sizeof(struct cyclic_entry));
+    if (cyclic_table == NULL)
+        return -1;
+    cyclic_len = cyclic_run_edf(end, offset, jobs, loop_at, &cyclic_loop, cyclic_table);
+    cyclic_next = 0;
+    return 0;
+}
+
+void schedule_cyclic_exit(struct thread *t)
+{
+    for (int i = 0; i < cyclic_nthreads; i++) {
+        if (cyclic_threads[i] == t)
+            cyclic_threads[i] = NULL;
+    }
+}
+
+struct threads_sched_result schedule_cyclic(struct threads_sched_args args)
+{
+    struct threads_sched_result r;
+
+    if (cyclic_next == cyclic_len) {
+        if (cyclic_loop < 0)
+            return sleep_until_release(args);
+        cyclic_next = cyclic_loop;
+    }
+
+    struct cyclic_entry *e = &cyclic_table[cyclic_next++];
+    struct thread *t = e->slot >= 0 ? cyclic_threads[e->slot] : NULL;
+
+    // a slot whose thread has exited, is blocked, or whose job is not out
+    // yet idles
+    if (t == NULL || t->blocked || t->remaining_time <= 0
+        || t->current_deadline - t->deadline > args.current_time) {
+        r.scheduled_thread_list_member = args.run_queue;
+    } else {
+        r.scheduled_thread_list_member = &t->thread_list;
+    }
+    r.allocated_time = e->ticks;
+    return r;
+}
@@ -3,6 +3,8 @@
 
 #include "user/list.h"
 
+struct thread;
+
 struct threads_sched_args {
     // the number of ticks since threading starts
     int current_time;
@@ -27,5 +29,22 @@ struct threads_sched_result schedule_wrr(struct threads_sched_args args);
 struct threads_sched_result schedule_sjf(struct threads_sched_args args);
 struct threads_sched_result schedule_lst(struct threads_sched_args args);
 struct threads_sched_result schedule_dm(struct threads_sched_args args);
+struct threads_sched_result schedule_mlfq(struct threads_sched_args args);
+struct threads_sched_result schedule_cfs(struct threads_sched_args args);
+
+// CFS keeps runnable threads in a tree ordered by virtual runtime,
+// the runtime calls these whenever a thread enters or leaves the run queue
+void schedule_cfs_enqueue(struct thread *t);
+void schedule_cfs_dequeue(struct thread *t);
+
+struct threads_sched_result schedule_cbs(struct threads_sched_args args);
+void schedule_cbs_set_server(int budget, int period);
+
+// the cyclic executive builds its dispatch table from the release queue
+// once, before threading starts, and returns -1 if the task set is not
+// periodic or cannot be scheduled; it is told when a thread exits
+struct threads_sched_result schedule_cyclic(struct threads_sched_args args);
+int schedule_cyclic_build(struct threads_sched_args args);
+void schedule_cyclic_exit(struct thread *t);
 
 #endif
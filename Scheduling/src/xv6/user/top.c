@@ -0,0 +1,106 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/procinfo.h"
+#include "user/user.h"
+
+// show what the processes are doing, busiest first: sample
+// getprocinfo() every interval ticks, count times.
+//
+//   top [interval [count]]     default: 10 ticks, 5 samples
+//
+// cpu% is the share of one cpu used over the last interval,
+// so it goes up to 100 times the number of cpus in total.
+
+#define MAXPROCS 256
+
+static char *states[] = {"unused", "sleep", "runble", "run", "zombie"};
+
+struct sample {
+  struct procinfo pi;
+  int busy;          // ticks used since the previous sample
+};
+
+static struct sample cur[MAXPROCS];
+static int lastpid[MAXPROCS];
+static uint64 lastticks[MAXPROCS];
+static int nlast;
+
+// ticks pi used since the last sample, or since it started
+// if it was not there yet.
+static int
+busy(struct procinfo *pi)
+{
+  int i;
+
+  for(i = 0; i < nlast; i++){
+    if(lastpid[i] == pi->pid)
+      return pi->utime + pi->stime - lastticks[i];
+  }
+  return pi->utime + pi->stime;
+}
+
+static int
+collect(void)
+{
+  struct procinfo pi;
+  int pid, n = 0, i;
+
+  for(pid = 1; n < MAXPROCS && (pid = getprocinfo(pid, &pi)) > 0; pid++){
+    // insert it sorted by busy, then by pid.
+    int b = busy(&pi);
+    for(i = n; i > 0 && cur[i - 1].busy < b; i--)
+      cur[i] = cur[i - 1];
+    cur[i].pi = pi;
+    cur[i].busy = b;
+    n++;
+  }
+  return n;
+}
+
+static void
+show(int n, int interval)
+{
+  struct procinfo *pi;
+  int i;
+
+  printf("\nuptime %d, %d processes\n", uptime(), n);
+  printf("pid\tppid\tstate\tcpu%%\tuser\tsys\tvcsw\tivcsw\tread\twrite\tpages\tname\n");
+  for(i = 0; i < n; i++){
+    pi = &cur[i].pi;
+    printf("%d\t%d\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%s\n",
+           pi->pid, pi->ppid,
+           pi->state >= 0 && pi->state < 5 ? states[pi->state] : "???",
+           cur[i].busy * 100 / interval,
+           (int)pi->utime, (int)pi->stime, (int)pi->nvcsw, (int)pi->nivcsw,
+           (int)pi->rblocks, (int)pi->wblocks, (int)pi->pages, pi->name);
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  int interval = 10, count = 5, n, i, t;
+
+  if(argc > 1)
+    interval = atoi(argv[1]);
+  if(argc > 2)
+    count = atoi(argv[2]);
+  if(interval < 1 || count < 1){
+    fprintf(2, "usage: top [interval [count]]\n");
+    exit(1);
+  }
+
+  // a first sample, so the first report covers one interval.
+  n = collect();
+  for(t = 0; t < count; t++){
+    for(i = 0; i < n; i++){
+      lastpid[i] = cur[i].pi.pid;
+      lastticks[i] = cur[i].pi.utime + cur[i].pi.stime;
+    }
+    nlast = n;
+    sleep(interval);
+    n = collect();
+    show(n, interval);
+  }
+  exit(0);
+}
@@ -1,4 +1,5 @@
 struct stat;
+struct procinfo;
 struct rtcdate;
 
 // system calls
@@ -27,6 +28,13 @@ int uptime(void);
 int thrdstop(int delay, int *thrdstop_context_id_ptr, void (*handler)(void *), void *handler_arg);
 int thrdresume(int thrdstop_context_id);
 int cancelthrdstop( int thrdstop_context_id, int is_exit);
+int thrdsleep(void);
+int clone(void (*fn)(void *), void *arg, void *stack, int tp);
+int setpriority(int pid, int nice);
+int settickets(int n);
+int getprocinfo(int pid, struct procinfo*);
+int setaffinity(int pid, uint64 mask);
+int sched_setattr(int runtime, int period, int deadline);
 
 // ulib.c
 int stat(const char*, struct stat*);
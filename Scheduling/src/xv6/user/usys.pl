@@ -40,4 +40,11 @@ entry("uptime");
 entry("thrdstop");
 entry("thrdresume");
 entry("cancelthrdstop");
+entry("thrdsleep");
+entry("clone");
+entry("setpriority");
+entry("settickets");
+entry("getprocinfo");
+entry("setaffinity");
+entry("sched_setattr");
 